@@ -1,5 +1,9 @@
 ROOT=../src/
 clang++ \
+    $ROOT"base/Allocator.cpp" \
+    $ROOT"base/CacheInfo.cpp" \
+    $ROOT"base/Crc32c.cpp" \
+    $ROOT"base/StreamingMemcpy.cpp" \
     $ROOT"core/DecoderLut.cpp" \
     $ROOT"core/EncoderLut.cpp" \
     $ROOT"buffer/BaseBufferProcessor.cpp" \
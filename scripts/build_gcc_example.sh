@@ -1,6 +1,10 @@
 ROOT=../src/
 g++ \
     $ROOT"base/Timing.cpp" \
+    $ROOT"base/Allocator.cpp" \
+    $ROOT"base/CacheInfo.cpp" \
+    $ROOT"base/Crc32c.cpp" \
+    $ROOT"base/StreamingMemcpy.cpp" \
     $ROOT"core/DecoderLut.cpp" \
     $ROOT"core/EncoderLut.cpp" \
     $ROOT"buffer/BaseBufferProcessor.cpp" \
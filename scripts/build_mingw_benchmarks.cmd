@@ -0,0 +1,20 @@
+set ROOT=../src/
+g++ ^
+    %ROOT%base/Timing.cpp ^
+    %ROOT%base/Allocator.cpp ^
+    %ROOT%base/CacheInfo.cpp ^
+    %ROOT%base/Crc32c.cpp ^
+    %ROOT%base/StreamingMemcpy.cpp ^
+    %ROOT%core/DecoderLut.cpp ^
+    %ROOT%core/EncoderLut.cpp ^
+    %ROOT%buffer/BaseBufferProcessor.cpp ^
+    %ROOT%buffer/AllProcessors.cpp ^
+    %ROOT%message/MessageConverter.cpp ^
+    %ROOT%tests/CorpusGenerator.cpp ^
+    %ROOT%tests/Benchmarks.cpp ^
+    %ROOT%iconv/iconv.cpp ^
+    -I"../src" -o"Benchmarks_mingw.exe" ^
+    -D NDEBUG -D ICONV_UTF8LUT_BUILD ^
+    -std=c++11 -mssse3 -O3 -pthread
+
+strip Benchmarks_mingw.exe
@@ -1,11 +1,17 @@
 set ROOT=../src/
 g++ ^
     %ROOT%base/Timing.cpp ^
+    %ROOT%base/Allocator.cpp ^
+    %ROOT%base/CacheInfo.cpp ^
+    %ROOT%base/Crc32c.cpp ^
+    %ROOT%base/StreamingMemcpy.cpp ^
+    %ROOT%base/PerfCounters.cpp ^
     %ROOT%core/DecoderLut.cpp ^
     %ROOT%core/EncoderLut.cpp ^
     %ROOT%buffer/BaseBufferProcessor.cpp ^
     %ROOT%buffer/AllProcessors.cpp ^
     %ROOT%message/MessageConverter.cpp ^
+    %ROOT%tests/CorpusGenerator.cpp ^
     %ROOT%tests/FileConverter.cpp ^
     -I"../src" -o"FileConverter_mingw.exe" ^
     -D NDEBUG -D TIMING ^
@@ -57,7 +57,7 @@ def parse_log(log_name):
     if m:
         external_result = float(m.group(1))
     # internal timings in utf8lut
-    for m in re.finditer(r'slot \d+\s+(DECODE|ENCODE)\s+:\s+([\d.]+) cyc/el\s+(\d+) elems\n', text):
+    for m in re.finditer(r'slot \d+\s+(DECODE|ENCODE)\s+:\s+([\d.]+) cyc/el\s+(\d+) elems\b', text):
         if int(m.group(3)) > 0:
             internal_result = float(m.group(2))
     # internal timings in u8u16
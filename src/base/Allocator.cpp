@@ -0,0 +1,32 @@
+#include "base/Allocator.h"
+#include <emmintrin.h>
+#include <atomic>
+#include <new>
+
+void *DefaultAllocator::Allocate(size_t bytes, size_t alignment) {
+    void *ptr = _mm_malloc(bytes > 0 ? bytes : 1, alignment);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void DefaultAllocator::Deallocate(void *ptr, size_t /*bytes*/, size_t /*alignment*/) {
+    _mm_free(ptr);
+}
+
+DefaultAllocator &DefaultAllocator::Instance() {
+    static DefaultAllocator instance;
+    return instance;
+}
+
+static std::atomic<BaseAllocator*> globalAllocator(0);
+
+BaseAllocator &GetGlobalAllocator() {
+    BaseAllocator *allocator = globalAllocator.load(std::memory_order_acquire);
+    return allocator ? *allocator : DefaultAllocator::Instance();
+}
+
+BaseAllocator *SetGlobalAllocator(BaseAllocator *allocator) {
+    BaseAllocator *previous = globalAllocator.exchange(allocator, std::memory_order_acq_rel);
+    return previous ? previous : &DefaultAllocator::Instance();
+}
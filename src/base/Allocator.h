@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+// Interface of memory allocator (similar to std::pmr::memory_resource from C++17).
+// All the buffers allocated by the library (plugins, output of ConvertInMemorySize, lookup tables)
+// are obtained from an allocator, so you can route them to your own arena or pool.
+// An allocator can be set globally (see SetGlobalAllocator) or per processor (see BaseBufferProcessor::SetAllocator).
+class BaseAllocator {
+public:
+    virtual ~BaseAllocator() {}
+    // Allocates a memory block of given size with given alignment (a power of two).
+    // Must never return null pointer.
+    virtual void *Allocate(size_t bytes, size_t alignment) = 0;
+    // Frees a memory block previously returned by 'Allocate' of the same allocator.
+    // The size and the alignment are exactly the same as were passed to 'Allocate'.
+    virtual void Deallocate(void *ptr, size_t bytes, size_t alignment) = 0;
+};
+
+// The allocator used by default: takes memory from heap via _mm_malloc / _mm_free.
+class DefaultAllocator : public BaseAllocator {
+public:
+    virtual void *Allocate(size_t bytes, size_t alignment);
+    virtual void Deallocate(void *ptr, size_t bytes, size_t alignment);
+    // Returns the only instance of default allocator.
+    static DefaultAllocator &Instance();
+};
+
+// Returns the global allocator, which is used when no allocator is set for a processor.
+// It is also used for lookup tables, which are created once and never freed.
+BaseAllocator &GetGlobalAllocator();
+
+// Sets the global allocator, null pointer restores the default one.
+// Returns the previous global allocator.
+// Note: the memory must be freed by the same allocator which has allocated it,
+// so it is better to set global allocator at startup, before any processor is created.
+BaseAllocator *SetGlobalAllocator(BaseAllocator *allocator);
@@ -0,0 +1,122 @@
+#include "base/CacheInfo.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    static void CpuId(int leaf, int subleaf, unsigned regs[4]) {
+        int res[4];
+        __cpuidex(res, leaf, subleaf);
+        for (int i = 0; i < 4; i++)
+            regs[i] = unsigned(res[i]);
+    }
+#else
+    #include <cpuid.h>
+    static void CpuId(int leaf, int subleaf, unsigned regs[4]) {
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+    }
+#endif
+
+//saves size of a cache described by its level and type
+static void RegisterCache(CacheSizes &sizes, int level, bool data, long long bytes) {
+    if (bytes <= 0 || bytes > (1LL<<30))
+        return;
+    if (level == 1 && data)
+        sizes.l1d = int(bytes);
+    if (level == 2)
+        sizes.l2 = int(bytes);
+    if (level == 3)
+        sizes.l3 = int(bytes);
+}
+
+//reads cache description from /sys/devices/system/cpu/cpu0/cache/indexN
+static bool DetectFromSysfs(CacheSizes &sizes) {
+#ifdef __linux__
+    bool found = false;
+    for (int idx = 0; idx < 16; idx++) {
+        char path[256], type[64] = {0};
+        int level = 0;
+        long long value = 0;
+        char suffix = 0;
+
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        FILE *f = fopen(path, "rt");
+        if (!f) break;
+        int ok = fscanf(f, "%d", &level);
+        fclose(f);
+        if (ok != 1) continue;
+
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+        if (!(f = fopen(path, "rt"))) continue;
+        ok = fscanf(f, "%63s", type);
+        fclose(f);
+        if (ok != 1 || strcmp(type, "Instruction") == 0) continue;
+
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        if (!(f = fopen(path, "rt"))) continue;
+        ok = fscanf(f, "%lld%c", &value, &suffix);
+        fclose(f);
+        if (ok < 1) continue;
+        if (suffix == 'K') value <<= 10;
+        if (suffix == 'M') value <<= 20;
+
+        RegisterCache(sizes, level, true, value);
+        found = true;
+    }
+    return found;
+#else
+    return false;
+#endif
+}
+
+//uses "deterministic cache parameters" leaf: 4 on Intel, 0x8000001D on AMD
+static bool DetectFromCpuid(CacheSizes &sizes) {
+    unsigned regs[4];
+    CpuId(0, 0, regs);
+    int maxLeaf = int(regs[0]);
+    char vendor[13] = {0};
+    memcpy(vendor + 0, &regs[1], 4);
+    memcpy(vendor + 4, &regs[3], 4);
+    memcpy(vendor + 8, &regs[2], 4);
+
+    unsigned leaf = 4;
+    if (strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0) {
+        CpuId(0x80000000U, 0, regs);
+        if (regs[0] < 0x8000001DU)
+            return false;
+        leaf = 0x8000001DU;
+    }
+    else if (maxLeaf < 4)
+        return false;
+
+    bool found = false;
+    for (int sub = 0; sub < 16; sub++) {
+        CpuId(leaf, sub, regs);
+        int type = regs[0] & 0x1F;
+        if (type == 0)
+            break;  //no more caches
+        if (type == 2)
+            continue;   //instruction cache
+        int level = (regs[0] >> 5) & 0x7;
+        long long ways = ((regs[1] >> 22) & 0x3FF) + 1;
+        long long partitions = ((regs[1] >> 12) & 0x3FF) + 1;
+        long long lineSize = (regs[1] & 0xFFF) + 1;
+        long long sets = (long long)regs[2] + 1;
+        RegisterCache(sizes, level, true, ways * partitions * lineSize * sets);
+        found = true;
+    }
+    return found;
+}
+
+static CacheSizes DetectCacheSizes() {
+    CacheSizes sizes;
+    memset(&sizes, 0, sizeof(sizes));
+    if (!DetectFromSysfs(sizes))
+        DetectFromCpuid(sizes);
+    return sizes;
+}
+
+const CacheSizes &GetCacheSizes() {
+    static const CacheSizes sizes = DetectCacheSizes();
+    return sizes;
+}
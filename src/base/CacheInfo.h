@@ -0,0 +1,14 @@
+#pragma once
+
+// Sizes of data caches of the CPU (in bytes).
+// Zero value means that size of the corresponding cache level could not be detected.
+struct CacheSizes {
+    int l1d;    //L1 data cache (per core)
+    int l2;     //L2 cache (usually per core)
+    int l3;     //L3 cache (usually shared)
+};
+
+// Returns sizes of data caches of the CPU running the program.
+// On Linux, the information is read from sysfs; if it fails, cpuid instruction is used.
+// Detection happens only on the first call, the result is cached afterwards.
+const CacheSizes &GetCacheSizes();
@@ -0,0 +1,84 @@
+#include "base/Crc32c.h"
+#include <string.h>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #include <nmmintrin.h>
+    #define TARGET_SSE42
+    static bool DetectSse42() {
+        int regs[4];
+        __cpuid(regs, 1);
+        return (regs[2] >> 20) & 1;
+    }
+#else
+    #include <cpuid.h>
+    #include <nmmintrin.h>
+    //note: the whole library is compiled for SSSE3, so SSE 4.2 is enabled only for one function
+    #define TARGET_SSE42 __attribute__((target("sse4.2")))
+    static bool DetectSse42() {
+        unsigned regs[4];
+        if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+            return false;
+        return (regs[2] >> 20) & 1;
+    }
+#endif
+
+//reflected Castagnoli polynomial
+static const uint32_t Polynomial = 0x82F63B78U;
+
+bool HasHardwareCrc32c() {
+    static const bool result = DetectSse42();
+    return result;
+}
+
+TARGET_SSE42 uint32_t Crc32cHardware(uint32_t crc, const void *data, size_t size) {
+    const unsigned char *ptr = (const unsigned char *)data;
+    crc = ~crc;
+    for (; size > 0 && (size_t(ptr) & 7); size--)
+        crc = _mm_crc32_u8(crc, *ptr++);
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, ptr += 8) {
+        uint64_t value;
+        memcpy(&value, ptr, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = uint32_t(crc64);
+#else
+    for (; size >= 4; size -= 4, ptr += 4) {
+        uint32_t value;
+        memcpy(&value, ptr, 4);
+        crc = _mm_crc32_u32(crc, value);
+    }
+#endif
+    for (; size > 0; size--)
+        crc = _mm_crc32_u8(crc, *ptr++);
+    return ~crc;
+}
+
+struct Crc32cTable {
+    uint32_t values[256];
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int b = 0; b < 8; b++)
+                crc = (crc >> 1) ^ (crc & 1 ? Polynomial : 0);
+            values[i] = crc;
+        }
+    }
+};
+
+uint32_t Crc32cSoftware(uint32_t crc, const void *data, size_t size) {
+    static const Crc32cTable table;
+    const unsigned char *ptr = (const unsigned char *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = (crc >> 8) ^ table.values[(crc ^ ptr[i]) & 0xFF];
+    return ~crc;
+}
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size) {
+    if (HasHardwareCrc32c())
+        return Crc32cHardware(crc, data, size);
+    return Crc32cSoftware(crc, data, size);
+}
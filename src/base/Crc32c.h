@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C checksum (Castagnoli polynomial), as used in iSCSI, ext4, Btrfs, etc.
+// The checksum can be computed incrementally: start with crc = 0, then pass the result of
+// previous call for every next piece of data, i.e. Crc32c(Crc32c(0, A), B) = Crc32c(0, AB).
+// SSE 4.2 instruction crc32 is used if CPU supports it (checked at runtime), otherwise a lookup table is used.
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size);
+
+// Returns true if CPU supports SSE 4.2, i.e. Crc32c is computed in hardware.
+bool HasHardwareCrc32c();
+
+// Implementations of Crc32c: they are exposed only for testing.
+// Note: hardware version must not be called if HasHardwareCrc32c returns false.
+uint32_t Crc32cHardware(uint32_t crc, const void *data, size_t size);
+uint32_t Crc32cSoftware(uint32_t crc, const void *data, size_t size);
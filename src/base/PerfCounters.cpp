@@ -0,0 +1,154 @@
+#include "base/PerfCounters.h"
+#include <string.h>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+    #include <stdint.h>
+    #include <cpuid.h>
+#endif
+
+HardwareCounters::HardwareCounters() {
+    opened = false;
+    for (int i = 0; i < hcCount; i++) {
+        fds[i] = -1;
+        values[i] = 0;
+    }
+}
+
+HardwareCounters::~HardwareCounters() {
+#ifdef __linux__
+    for (int i = 0; i < hcCount; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+#endif
+}
+
+const char *HardwareCounters::GetName(int type) {
+    static const char *names[hcCount] = {
+        "cycles", "instructions", "L1d-misses", "L2-misses", "LLC-misses", "dTLB-misses", "branch-misses"
+    };
+    return type >= 0 && type < hcCount ? names[type] : 0;
+}
+
+bool HardwareCounters::IsAvailable(int type) const {
+    return type >= 0 && type < hcCount && fds[type] >= 0;
+}
+
+long long HardwareCounters::GetValue(int type) const {
+    return IsAvailable(type) ? values[type] : 0;
+}
+
+#ifdef __linux__
+
+static uint64_t CacheEvent(int cache, int op, int result) {
+    return uint64_t(cache) | (uint64_t(op) << 8) | (uint64_t(result) << 16);
+}
+
+static bool IsIntelCpu() {
+    unsigned regs[4] = {0};
+    if (!__get_cpuid(0, &regs[0], &regs[1], &regs[2], &regs[3]))
+        return false;
+    //vendor string is in EBX, EDX, ECX
+    return regs[1] == 0x756E6547U && regs[3] == 0x49656E69U && regs[2] == 0x6C65746EU;
+}
+
+static int OpenCounter(int type) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (type) {
+        case hcCycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case hcInstructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case hcL1dMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = CacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case hcL2Misses:
+            //there is no generic event for L2, use L2_RQSTS.MISS (Haswell and later)
+            if (!IsIntelCpu())
+                return -1;
+            attr.type = PERF_TYPE_RAW;
+            attr.config = 0x3F24;
+            break;
+        case hcLlcMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = CacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case hcDtlbMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = CacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case hcBranchMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            return -1;
+    }
+
+    //current thread, any CPU, no group
+    long fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    return fd < 0 ? -1 : int(fd);
+}
+
+bool HardwareCounters::Start() {
+    if (!opened) {
+        for (int i = 0; i < hcCount; i++)
+            fds[i] = OpenCounter(i);
+        opened = true;
+    }
+    bool any = false;
+    for (int i = 0; i < hcCount; i++) {
+        values[i] = 0;
+        if (fds[i] < 0)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        any = true;
+    }
+    return any;
+}
+
+void HardwareCounters::Stop() {
+    for (int i = 0; i < hcCount; i++)
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (int i = 0; i < hcCount; i++) {
+        if (fds[i] < 0)
+            continue;
+        //value, time enabled, time running
+        uint64_t data[3] = {0};
+        if (read(fds[i], data, sizeof(data)) != sizeof(data)) {
+            values[i] = 0;
+            continue;
+        }
+        double scale = (data[2] > 0 && data[2] < data[1] ? double(data[1]) / data[2] : 1.0);
+        values[i] = (long long)(data[0] * scale);
+    }
+}
+
+#else
+
+bool HardwareCounters::Start() {
+    opened = true;
+    return false;
+}
+
+void HardwareCounters::Stop() {
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+// Hardware performance counters of the CPU.
+// On Linux they are read with perf_event_open syscall, on other platforms they are not available.
+// Only user-space events of the current thread are counted.
+enum HardwareCounterType {
+    hcCycles,           // CPU cycles
+    hcInstructions,     // retired instructions
+    hcL1dMisses,        // L1 data cache read misses
+    hcL2Misses,         // L2 cache misses (Intel only, raw event L2_RQSTS.MISS)
+    hcLlcMisses,        // last level cache read misses
+    hcDtlbMisses,       // data TLB read misses
+    hcBranchMisses,     // mispredicted branches
+    hcCount             //(helper)
+};
+
+// Set of counters measuring one region of code, e.g.:
+//   HardwareCounters counters;
+//   counters.Start();
+//   ... measured code ...
+//   counters.Stop();
+//   if (counters.IsAvailable(hcCycles)) printf("%lld cycles\n", counters.GetValue(hcCycles));
+// Some (or all) counters may be unavailable: e.g. if kernel forbids them (see perf_event_paranoid),
+// or if CPU / virtual machine does not support them. In such case IsAvailable returns false.
+// If kernel multiplexes counters, then values are scaled proportionally to the time they were running.
+class HardwareCounters {
+public:
+    HardwareCounters();
+    ~HardwareCounters();
+
+    // Opens counters (on first call), resets and starts them.
+    // Returns false if no counter is available at all.
+    bool Start();
+    // Stops counters and remembers their values.
+    void Stop();
+
+    bool IsAvailable(int type) const;
+    // Returns value of counter measured between the last Start and Stop calls.
+    long long GetValue(int type) const;
+    // Returns short name of the counter, e.g. "L1d-misses".
+    static const char *GetName(int type);
+
+private:
+    HardwareCounters(const HardwareCounters&);
+    HardwareCounters& operator=(const HardwareCounters&);
+
+    bool opened;
+    int fds[hcCount];
+    long long values[hcCount];
+};
@@ -0,0 +1,10 @@
+#include "base/StreamingMemcpy.h"
+#include <string.h>
+#include <emmintrin.h>
+//defines CustomMemcpy_nt_t: copy with non-temporal stores
+#define MEMCPY_WRITE_NT
+#include "base/CustomMemcpy.h"
+
+void StreamingMemcpy(char *dst, const char *src, size_t num) {
+    CustomMemcpy_nt_t(dst, src, num);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+
+// Copies memory with non-temporal (streaming) stores, so that destination does not pollute caches.
+// Use it only for large destination which is not going to be read soon (see BaseBufferProcessor::SetOutputStoreMode).
+// Source is read with ordinary loads, a store fence is issued at the end.
+void StreamingMemcpy(char *dst, const char *src, size_t num);
@@ -2,16 +2,126 @@
 
 #ifdef TIMING
 
-TimingData timingData = TimingData();
+//list of all timing blocks ever created (only grows)
+static std::atomic<TimingThreadData*> timingThreads(0);
+
+//releases timing block when its thread finishes
+struct TimingThreadHolder {
+    TimingThreadData *data;
+    ~TimingThreadHolder() {
+        if (data)
+            data->used.store(false, std::memory_order_release);
+        timingLocal = 0;
+    }
+};
+static thread_local TimingThreadHolder timingHolder = {0};
+thread_local TimingThreadData *timingLocal = 0;
+
+TimingThreadData *TimingAttachThread() {
+    TimingThreadData *data = 0;
+    //try to reuse block of some finished thread
+    for (TimingThreadData *ptr = timingThreads.load(std::memory_order_acquire); ptr; ptr = ptr->next) {
+        bool expected = false;
+        if (ptr->used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            data = ptr;
+            break;
+        }
+    }
+    if (!data) {
+        data = new TimingThreadData();
+        for (int i = 0; i < TIMING_MAX; i++) {
+            TimingSlotData &slot = data->slots[i];
+            slot.totalTime.store(0);
+            slot.totalElems.store(0);
+            slot.totalCalls.store(0);
+            for (int b = 0; b < TIMING_BUCKETS; b++)
+                slot.histogram[b].store(0);
+            data->startTime[i] = 0;
+        }
+        data->used.store(true);
+        //push to the head of the list
+        TimingThreadData *head = timingThreads.load(std::memory_order_relaxed);
+        do {
+            data->next = head;
+        } while (!timingThreads.compare_exchange_weak(head, data, std::memory_order_release, std::memory_order_relaxed));
+    }
+    timingHolder.data = data;
+    timingLocal = data;
+    return data;
+}
+
+void TimingCollect(int slot, TimingTotals &totals) {
+    assert(slot >= 0 && slot < TIMING_MAX);
+    totals = TimingTotals();
+    for (TimingThreadData *ptr = timingThreads.load(std::memory_order_acquire); ptr; ptr = ptr->next) {
+        const TimingSlotData &data = ptr->slots[slot];
+        totals.totalTime += data.totalTime.load(std::memory_order_relaxed);
+        totals.totalElems += data.totalElems.load(std::memory_order_relaxed);
+        totals.totalCalls += data.totalCalls.load(std::memory_order_relaxed);
+        for (int b = 0; b < TIMING_BUCKETS; b++)
+            totals.histogram[b] += data.histogram[b].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t TimingTotals::GetPercentile(double fraction) const {
+    uint64_t cnt = 0;
+    for (int b = 0; b < TIMING_BUCKETS; b++)
+        cnt += histogram[b];
+    if (cnt == 0)
+        return 0;
+    //number of calls which must be covered
+    uint64_t need = uint64_t(fraction * cnt + 0.5);
+    if (need < 1) need = 1;
+    if (need > cnt) need = cnt;
+    uint64_t sum = 0;
+    for (int b = 0; b < TIMING_BUCKETS; b++) {
+        sum += histogram[b];
+        if (sum >= need)
+            return b == 0 ? 0 : b == 64 ? UINT64_MAX : (uint64_t(1) << b) - 1;
+    }
+    return UINT64_MAX;
+}
+
 void TimingPrintAll(FILE *f) {
     #define TIMING_X_PRINT(name, idx) \
         if (idx == TIMING_MAX) return; \
-        fprintf(f, "slot %d %10s : %6.3f cyc/el  %12" PRIu64 " elems\n", \
-            idx, #name, \
-            timingData.totalTime[idx] / (timingData.totalElems[idx] + 1e-9), \
-            timingData.totalElems[idx] \
-        );
+        { \
+            TimingTotals totals; \
+            TimingCollect(idx, totals); \
+            if (totals.totalCalls > 0) \
+                fprintf(f, "slot %d %14s : %6.3f cyc/el  %12" PRIu64 " elems  %9" PRIu64 " calls  p50/p99/p999 <= %" PRIu64 "/%" PRIu64 "/%" PRIu64 " cyc\n", \
+                    idx, #name, \
+                    totals.totalTime / (totals.totalElems + 1e-9), \
+                    totals.totalElems, totals.totalCalls, \
+                    totals.GetPercentile(0.5), totals.GetPercentile(0.99), totals.GetPercentile(0.999) \
+                ); \
+        }
     TIMING_SLOTS(TIMING_X_PRINT);
 }
 
+void TimingExportJson(FILE *f) {
+    bool first = true;
+    fprintf(f, "{\n  \"slots\": [");
+    #define TIMING_X_JSON(name, idx) \
+        if (idx != TIMING_MAX) { \
+            TimingTotals totals; \
+            TimingCollect(idx, totals); \
+            int lastBucket = TIMING_BUCKETS - 1; \
+            while (lastBucket > 0 && totals.histogram[lastBucket] == 0) \
+                lastBucket--; \
+            fprintf(f, "%s\n    {\"name\": \"%s\", \"cycles\": %" PRIu64 ", \"elems\": %" PRIu64 ", \"calls\": %" PRIu64 ", ", \
+                (first ? "" : ","), #name, totals.totalTime, totals.totalElems, totals.totalCalls \
+            ); \
+            fprintf(f, "\"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p999\": %" PRIu64 ", \"histogram\": [", \
+                totals.GetPercentile(0.5), totals.GetPercentile(0.99), totals.GetPercentile(0.999) \
+            ); \
+            for (int b = 0; b <= lastBucket; b++) \
+                fprintf(f, "%s%" PRIu64, (b ? ", " : ""), totals.histogram[b]); \
+            fprintf(f, "]}"); \
+            first = false; \
+        }
+    TIMING_SLOTS(TIMING_X_JSON);
+    fprintf(f, "\n  ]\n}\n");
+}
+
 #endif
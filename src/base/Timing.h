@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <stdio.h>
+#include <atomic>
 
 #ifdef _MSC_VER
     #define PRIu64 "I64u"
@@ -24,10 +25,21 @@ static inline uint64_t get_ticks() {
     return __rdtsc();
 }
 
+//note: FAST and SLOW slots measure every call of core / trivial conversion,
+//so they are enabled only if TIMING_FINE is defined (they distort all the other timings)
 #define TIMING_SLOTS(X) \
     X(DECODE, 1) \
     X(ENCODE, 2) \
-    X(MAX, 3)
+    X(FAST, 3) \
+    X(SLOW, 4) \
+    X(ERROR_CALLBACK, 5) \
+    X(PLUGIN_PRE, 6) \
+    X(PLUGIN_POST, 7) \
+    X(IO, 8) \
+    X(MAX, 9)
+
+//number of buckets in latency histogram: bucket k contains calls which took [2^(k-1), 2^k) cycles
+static const int TIMING_BUCKETS = 65;
 
 //======================================================
 
@@ -37,34 +49,90 @@ static inline uint64_t get_ticks() {
     static const int CONCAT(TIMING_, name) = idx;
 TIMING_SLOTS(TIMING_X_DEFINE);
 
-struct TimingData {
-    uint64_t totalTime[TIMING_MAX];
-    uint64_t totalElems[TIMING_MAX];
+//counters of one slot in one thread
+//they are changed only by the owning thread, but can be read by any thread at any moment
+struct TimingSlotData {
+    std::atomic<uint64_t> totalTime;
+    std::atomic<uint64_t> totalElems;
+    std::atomic<uint64_t> totalCalls;
+    std::atomic<uint64_t> histogram[TIMING_BUCKETS];
+};
+
+//all timing data of one thread
+//note: these blocks are never freed, a block of finished thread is reused by a new thread
+struct TimingThreadData {
+    TimingSlotData slots[TIMING_MAX];
     uint64_t startTime[TIMING_MAX];
+    std::atomic<bool> used;
+    TimingThreadData *next;
 };
 
-extern TimingData timingData;
+//returns timing data of the current thread (attaches it on first call)
+TimingThreadData *TimingAttachThread();
+extern thread_local TimingThreadData *timingLocal;
+static inline TimingThreadData &TimingGetLocal() {
+    TimingThreadData *data = timingLocal;
+    if (!data)
+        data = TimingAttachThread();
+    return *data;
+}
+
+//increments counter owned by the current thread (no atomic read-modify-write is necessary)
+static inline void TimingAdd(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline int TimingBucketOf(uint64_t ticks) {
+    int bucket = 0;
+    while (ticks) {
+        ticks >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static inline void TimingRecord(int slot, uint64_t elapsed, uint64_t elems) {
+    TimingSlotData &data = TimingGetLocal().slots[slot];
+    TimingAdd(data.totalTime, elapsed);
+    TimingAdd(data.totalElems, elems);
+    TimingAdd(data.totalCalls, 1);
+    TimingAdd(data.histogram[TimingBucketOf(elapsed)], 1);
+}
 
 //======================================================
 
 #define TIMING_START(name) { \
     int slot = CONCAT(TIMING_, name); \
-    uint64_t &startTime = timingData.startTime[slot]; \
+    uint64_t &startTime = TimingGetLocal().startTime[slot]; \
     startTime = get_ticks(); \
 }
 
 #define TIMING_END(name, elems) { \
     uint64_t endTime = get_ticks(); \
     int slot = CONCAT(TIMING_, name); \
-    uint64_t &startTime = timingData.startTime[slot]; \
+    uint64_t &startTime = TimingGetLocal().startTime[slot]; \
     assert(startTime != 0); \
-    timingData.totalTime[slot] += endTime - startTime; \
-    timingData.totalElems[slot] += uint64_t(elems); \
+    TimingRecord(slot, endTime - startTime, uint64_t(elems)); \
     startTime = 0; \
 }
 
+//aggregated data of one slot over all threads
+struct TimingTotals {
+    uint64_t totalTime;
+    uint64_t totalElems;
+    uint64_t totalCalls;
+    uint64_t histogram[TIMING_BUCKETS];
+
+    //returns upper bound of latency (in cycles) for the given fraction of calls (e.g. 0.99)
+    uint64_t GetPercentile(double fraction) const;
+};
+//sums counters of all threads (lock-free, can be called while other threads are working)
+void TimingCollect(int slot, TimingTotals &totals);
+
 void TimingPrintAll(FILE *f);
 #define TIMING_PRINT(f) TimingPrintAll(f);
+void TimingExportJson(FILE *f);
+#define TIMING_EXPORT_JSON(f) TimingExportJson(f);
 
 #else
 //if not asked (TIMING undefined), then define empty macros
@@ -72,5 +140,15 @@ void TimingPrintAll(FILE *f);
 #define TIMING_START(name)
 #define TIMING_END(name, elems)
 #define TIMING_PRINT(f)
+#define TIMING_EXPORT_JSON(f)
+
+#endif
 
+//fine-grained timings (only if TIMING_FINE is defined additionally)
+#if defined(TIMING) && defined(TIMING_FINE)
+    #define TIMING_FINE_START(name) TIMING_START(name)
+    #define TIMING_FINE_END(name, elems) TIMING_END(name, elems)
+#else
+    #define TIMING_FINE_START(name)
+    #define TIMING_FINE_END(name, elems)
 #endif
@@ -4,10 +4,14 @@
 
 #include "buffer/ProcessorSelector.h"
 
-BaseBufferProcessor* GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter) {
+BaseBufferProcessor* GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter, bool withStats) {
     #define TRY_PROC(from, to, maxB, mode, mult) \
-        if (srcFormat == from && dstFormat == to && maxBytes == maxB && checkMode == mode && multiplier == mult) \
-            res = ProcessorSelector<from, to>::template WithOptions<mode, maxB, mult>::Create(errorCounter);
+        if (srcFormat == from && dstFormat == to && maxBytes == maxB && checkMode == mode && multiplier == mult) { \
+            if (withStats) \
+                res = ProcessorSelector<from, to>::template WithOptions<mode, maxB, mult, true>::Create(errorCounter); \
+            else \
+                res = ProcessorSelector<from, to>::template WithOptions<mode, maxB, mult>::Create(errorCounter); \
+        }
 
     #define TRY_OPT(from, to, maxB, mode) \
         TRY_PROC(from, to, maxB, mode, 1); \
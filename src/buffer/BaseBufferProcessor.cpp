@@ -1,55 +1,65 @@
 #include "buffer/BaseBufferProcessor.h"
 #include "buffer/ProcessorPlugins.h"
+#include "base/CacheInfo.h"
+#include "base/Allocator.h"
+#include "base/Timing.h"
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
 
 BaseBufferProcessor::BaseBufferProcessor() {
     errorCallback = 0;
     errorContext = 0;
+    allocator = 0;
+    outputStoreMode = osAuto;
+    statsEnabled = false;
     Clear();
 }
 BaseBufferProcessor::~BaseBufferProcessor() {
 }
 
 void BaseBufferProcessor::Clear() {
-    inputBuffer = 0;
-    inputSize = 0;
-    memset(outputBuffer, 0, sizeof(outputBuffer));
-    memset(outputSize, 0, sizeof(outputSize));
-    inputDone = 0;
-    memset(outputDone, 0, sizeof(outputDone));
-    SetHint();
+    state = Context();
+    state.stats = (statsEnabled ? &stats : 0);
     pluginsCount = 0;
 }
 
 void BaseBufferProcessor::SetInputBuffer(const char *ptr, int size) {
-    inputBuffer = ptr;
-    inputSize = size;
+    state.inputBuffer = ptr;
+    state.inputSize = size;
 }
 
 void BaseBufferProcessor::SetOutputBuffer(char *ptr, int size, int index) {
     assert(index >= 0 && index < MaxStreamsCount);
-    outputBuffer[index] = ptr;
-    outputSize[index] = size;
+    state.outputBuffer[index] = ptr;
+    state.outputSize[index] = size;
 }
 
 bool BaseBufferProcessor::CheckBuffers() const {
+    return CheckBuffers(state);
+}
+
+bool BaseBufferProcessor::CheckBuffers(const Context &ctx) const {
     int streams = GetStreamsCount();
     //check input buffer validity
-    if (!inputBuffer || inputSize < 1 || inputSize > GetBufferMaxSize())
+    if (!ctx.inputBuffer || ctx.inputSize < 1 || ctx.inputSize > GetBufferMaxSize())
         return false;
     //check output buffers validity
     for (int i = 0; i < streams; i++)
-        if (!outputBuffer[i] || outputSize[i] < 1 || outputSize[i] > GetBufferMaxSize())
+        if (!ctx.outputBuffer[i] || ctx.outputSize[i] < 1 || ctx.outputSize[i] > GetBufferMaxSize())
             return false;
     //check for overlapping
     for (int i = -1; i < streams; i++)
         for (int j = i+1; j < streams; j++) {
-            const char *leftA = (i < 0 ? inputBuffer : outputBuffer[i]);
-            const char *rightA = leftA + (i < 0 ? inputSize : outputSize[i]);
-            const char *leftB = outputBuffer[j];
-            const char *rightB = leftB + outputSize[j];
+            const char *leftA = (i < 0 ? ctx.inputBuffer : ctx.outputBuffer[i]);
+            const char *rightA = leftA + (i < 0 ? ctx.inputSize : ctx.outputSize[i]);
+            const char *leftB = ctx.outputBuffer[j];
+            const char *rightB = leftB + ctx.outputSize[j];
             if (leftA >= rightB || leftB >= rightA)
                 continue;
             return false;
@@ -61,44 +71,74 @@ int BaseBufferProcessor::GetBufferMaxSize() const {
     return INT_MAX / 8;
 }
 
+int BaseBufferProcessor::GetCacheAwareBufferSize(int outputRatioNum, int outputRatioDen) {
+    static const int DefaultSize = 1<<16;   //64KB: used if cache size is unknown
+    static const int MinSize = 1<<14;       //16KB
+    static const int MaxSize = 1<<20;       //1MB
+    long long l2size = GetCacheSizes().l2;
+    if (l2size <= 0)
+        return DefaultSize;
+    //input + output of one chunk should take a quarter of L2
+    long long bytes = (l2size / 4) * outputRatioDen / (outputRatioDen + outputRatioNum);
+    int size = MinSize;
+    while (size < MaxSize && 2 * size <= bytes)
+        size *= 2;
+    return size;
+}
+
 void BaseBufferProcessor::SetHint(bool isLastBlock) {
-    lastBlockMode = isLastBlock;
+    state.lastBlockMode = isLastBlock;
 }
 
 bool BaseBufferProcessor::Process() {
+    TIMING_START(PLUGIN_PRE);
     for (int i = 0; i < pluginsCount; i++)
         plugins[i]->Pre();
+    TIMING_END(PLUGIN_PRE, pluginsCount);
+
+    bool res = Process(state);
+
+    TIMING_START(PLUGIN_POST);
+    for (int i = pluginsCount-1; i >= 0; i--)
+        plugins[i]->Post();
+    TIMING_END(PLUGIN_POST, pluginsCount);
+
+    return res;
+}
 
-    assert(CheckBuffers());
-    inputDone = 0;
-    memset(outputDone, 0, sizeof(outputDone));
+bool BaseBufferProcessor::Process(Context &ctx) const {
+    assert(CheckBuffers(ctx));
+    ctx.inputDone = 0;
+    memset(ctx.outputDone, 0, sizeof(ctx.outputDone));
 
-    bool res = _Process();
+    bool res = _Process(ctx);
     while (!res && errorCallback) {
-        const char *inputPtr = inputBuffer + inputDone;
-        char *outputPtr = outputBuffer[0] + outputDone[0];
-        bool fixed = errorCallback(errorContext, inputPtr, inputSize - inputDone, outputPtr, outputSize[0] - outputDone[0]);
-        inputDone = inputPtr - inputBuffer;
-        outputDone[0] = outputPtr - outputBuffer[0];
-        assert(inputDone >= 0 && inputDone <= inputSize);
-        assert(outputDone[0] >= 0 && outputDone[0] <= outputSize[0]);
+        const char *inputPtr = ctx.inputBuffer + ctx.inputDone;
+        char *outputPtr = ctx.outputBuffer[0] + ctx.outputDone[0];
+        bool fixed = CallErrorCallback(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, ctx.outputBuffer[0] + ctx.outputSize[0], statsEnabled ? ctx.stats : 0);
+        ctx.inputDone = inputPtr - ctx.inputBuffer;
+        ctx.outputDone[0] = outputPtr - ctx.outputBuffer[0];
+        assert(ctx.inputDone >= 0 && ctx.inputDone <= ctx.inputSize);
+        assert(ctx.outputDone[0] >= 0 && ctx.outputDone[0] <= ctx.outputSize[0]);
         if (!fixed)
             break;
-        res = _Process();
+        res = _Process(ctx);
     }
 
-    for (int i = pluginsCount-1; i >= 0; i--)
-        plugins[i]->Post();
-
     return res;
 }
 
 int BaseBufferProcessor::GetInputDoneSize() const {
-    return inputDone;
+    return state.inputDone;
 }
 
 int BaseBufferProcessor::GetOutputDoneSize(int index) const {
-    return outputDone[index];
+    return state.outputDone[index];
+}
+
+const char *BaseBufferProcessor::GetOutputBuffer(int index) const {
+    assert(index >= 0 && index < MaxStreamsCount);
+    return state.outputBuffer[index];
 }
 
 void BaseBufferProcessor::AddPlugin(BasePlugin &addedPlugin) {
@@ -106,6 +146,24 @@ void BaseBufferProcessor::AddPlugin(BasePlugin &addedPlugin) {
     plugins[pluginsCount++] = &addedPlugin;
 }
 
+bool BaseBufferProcessor::CallErrorCallback(const char *&inputPtr, const char *inputEnd, char *&outputPtr, char *outputEnd, Stats *stats) const {
+    if (!errorCallback)
+        return false;
+    if (stats)
+        stats->errorCallbacks++;
+    TIMING_START(ERROR_CALLBACK);
+    bool fixed = errorCallback(errorContext, inputPtr, int(inputEnd - inputPtr), outputPtr, int(outputEnd - outputPtr));
+    TIMING_END(ERROR_CALLBACK, 1);
+    return fixed;
+}
+
+int BaseBufferProcessor::ProcessBatch(int count, const char *inputData, const int *inputOffsets, char *outputData, int outputSize, int *outputOffsets, unsigned char *statuses, Stats *stats) const {
+    assert(count >= 0 && inputOffsets && outputOffsets);
+    assert(count == 0 || (inputData && outputData && statuses));
+    assert(outputSize >= GetStreamsCount() * GetOutputBufferMinSize(inputOffsets[count] - inputOffsets[0]));
+    return _ProcessBatch(count, inputData, inputOffsets, outputData, outputSize, outputOffsets, statuses, stats);
+}
+
 bool BaseBufferProcessor::SetErrorCallback(pfErrorCallback callback, ctxErrorCallback context) {
     if (GetStreamsCount() > 1)
         return false;   //not supported
@@ -113,3 +171,63 @@ bool BaseBufferProcessor::SetErrorCallback(pfErrorCallback callback, ctxErrorCal
     errorContext = context;
     return true;
 }
+
+void BaseBufferProcessor::SetAllocator(BaseAllocator *newAllocator) {
+    allocator = newAllocator;
+}
+
+BaseAllocator &BaseBufferProcessor::GetAllocator() const {
+    return allocator ? *allocator : GetGlobalAllocator();
+}
+
+void BaseBufferProcessor::SetOutputStoreMode(int mode) {
+    outputStoreMode = mode;
+}
+
+bool BaseBufferProcessor::IsStreamingOutput(long long outputSize) const {
+    static const long long DefaultThreshold = 1<<23;   //8MB: used if cache size is unknown
+    if (outputStoreMode != osAuto)
+        return outputStoreMode == osStreaming;
+    long long threshold = GetCacheSizes().l3;
+    if (threshold <= 0)
+        threshold = DefaultThreshold;
+    return outputSize > threshold;
+}
+
+void BaseBufferProcessor::EnableStats() {
+    statsEnabled = true;
+    state.stats = &stats;
+}
+
+unsigned long long BaseBufferProcessor::GetCycles() {
+    return __rdtsc();
+}
+
+void BaseBufferProcessor::Stats::Add(const Stats &other) {
+    fastBlocks += other.fastBlocks;
+    fastBytes += other.fastBytes;
+    slowCalls += other.slowCalls;
+    slowBytes += other.slowBytes;
+    errorCallbacks += other.errorCallbacks;
+    for (int i = 0; i < 4; i++)
+        codePoints[i] += other.codePoints[i];
+    cycles += other.cycles;
+}
+
+const BaseBufferProcessor::Stats *BaseBufferProcessor::GetStats() const {
+    return statsEnabled ? &stats : 0;
+}
+
+void BaseBufferProcessor::MergeStats(const Stats &other) {
+    stats.Add(other);
+}
+
+void BaseBufferProcessor::ResetStats() {
+    long long *lutHistogram = stats.lutHistogram;
+    stats = Stats();
+    stats.lutHistogram = lutHistogram;
+}
+
+void BaseBufferProcessor::SetLutHistogram(long long *counts) {
+    stats.lutHistogram = counts;
+}
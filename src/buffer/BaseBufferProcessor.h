@@ -4,6 +4,7 @@
 #include <assert.h>
 
 class BasePlugin;
+class BaseAllocator;
 
 // BaseBufferProcessor: base class for any processor, which can convert buffers of data.
 // As soon as you have created a suitable processor object,
@@ -69,13 +70,47 @@ class BasePlugin;
 // the default behavior of a validating processor is to simply stop before it.
 // If you want to convert invalid input by fixing the encoding errors, then you should set an error callback.
 // You can read more about it and find some ready-to-use error callbacks in ProcessorSelector.h.
+//
+// All the methods described above keep the state of conversion (buffers, hint, results) inside processor,
+// so a processor object must not be used from several threads simultaneously.
+// If you want to share one processor between threads, use the const overload of 'Process' method,
+// which takes all the state from a caller-owned Context struct and does not modify the processor.
+// Configuration methods (e.g. SetErrorCallback) must be called before sharing the processor.
 // 
 class BaseBufferProcessor {
 public:
     //maximum possible number of output streams among all available processors
     static const int MaxStreamsCount = 4;
     //a hard cap on the number of plugins that may be attached to a processor
-    static const int MaxPluginsCount = 2;
+    //(e.g. input plugin + output plugin + checksum plugin)
+    static const int MaxPluginsCount = 4;
+
+    //runtime statistics of conversion (see below)
+    struct Stats;
+
+    // All the state of one conversion call, see const overload of 'Process' method.
+    // The members have the same meaning as arguments and results of the stateful methods,
+    // e.g. inputBuffer/inputSize are set by SetInputBuffer, inputDone is returned by GetInputDoneSize.
+    struct Context {
+        //input buffer
+        const char *inputBuffer;
+        int inputSize;
+        //output buffers (one per stream)
+        char *outputBuffer[MaxStreamsCount];
+        int outputSize[MaxStreamsCount];
+        //the hint: would next block be last
+        bool lastBlockMode;
+        //how much bytes were processed
+        int inputDone;
+        int outputDone[MaxStreamsCount];
+        //where statistics of conversion is added (null if it is not needed), see GetStats
+        Stats *stats;
+
+        Context() {
+            memset(this, 0, sizeof(*this));
+            lastBlockMode = true;
+        }
+    };
 
     virtual ~BaseBufferProcessor();
 
@@ -108,10 +143,13 @@ public:
     //   * the output buffers are not large enough to hold converted result;
     //   * some buffers overlap;
     bool CheckBuffers() const;
+    bool CheckBuffers(const Context &ctx) const;
 
     // Returns the recommended size of an input buffer.
     // This size is considered to be good for performance.
     // Using much smaller of much larger buffer would slow down conversion.
+    // It is derived from the detected sizes of CPU caches and from the ratio of output size to input size,
+    // so that input and output chunks fit into L2 cache together (see also GetCacheAwareBufferSize).
     virtual int GetInputBufferRecommendedSize() const = 0;
 
     // Returns minimal allowed size of each output buffer, given the size of the input buffer.
@@ -148,6 +186,14 @@ public:
     // In order to learn how many bytes were converted, use methods GetInputDoneSize and GetOutputDoneSize.
     bool Process();
 
+    // Reentrant version of 'Process' method: it neither reads nor changes the state of processor.
+    // The buffers and the hint are taken from 'ctx', and the numbers of bytes converted are saved into it.
+    // Plugins are NOT called, but the error callback (if set) is used.
+    // It is safe to call this method for one processor from many threads at once (with different contexts).
+    // If processor collects statistics, then the counters are added to ctx.stats (if it is not null),
+    // so every thread should count into its own Stats, and merge them afterwards (see MergeStats).
+    bool Process(Context &ctx) const;
+
     // Returns how many bytes from the input buffer were successfully converted during the last 'Process' call.
     int GetInputDoneSize() const;
 
@@ -158,6 +204,10 @@ public:
     // you will obtain the real result of the conversion.
     int GetOutputDoneSize(int index = 0) const;
 
+    // Returns pointer to the output buffer of given stream (as set by SetOutputBuffer).
+    // After 'Process' call, the output data written during it is located at the beginning of this buffer.
+    const char *GetOutputBuffer(int index = 0) const;
+
     // Adds a plugin to processor.
     // You should NOT call this method directly,
     // because it is usually called in plugin's constructor.
@@ -182,9 +232,95 @@ public:
     // Error correction is not supported for processors with multi-stream output.
     // Note: error callback is NOT cleared when 'Clear' method is called.
     bool SetErrorCallback(pfErrorCallback callback = 0, ctxErrorCallback context = 0);
-    
+
+    // Sets allocator for all the memory allocated on behalf of this processor
+    // (e.g. internal buffers of plugins, output buffer in ConvertInMemorySize).
+    // If null pointer is passed (default), then the global allocator is used (see base/Allocator.h).
+    // Note: allocator is NOT cleared when 'Clear' method is called.
+    void SetAllocator(BaseAllocator *allocator = 0);
+    // Returns the allocator which must be used for memory related to this processor.
+    BaseAllocator &GetAllocator() const;
+
+    // Modes of storing output data into user's buffer (see SetOutputStoreMode).
+    enum OutputStoreMode {
+        osAuto = 0,         //streaming if user's output buffer is larger than L3 cache (default)
+        osTemporal = 1,     //ordinary stores: output data goes through caches
+        osStreaming = 2,    //non-temporal stores: output data goes directly to memory
+    };
+    // Sets how output plugins store converted data into user's output buffer (see ContiguousOutput).
+    // Ordinary stores read every cache line of output from memory before writing it (read-for-ownership),
+    // and large output evicts the lookup table and the input from caches.
+    // In streaming mode the processor writes into a small internal buffer (which stays in cache),
+    // then it is flushed to user's buffer with non-temporal stores (_mm_stream_si128).
+    // It saves as much memory traffic as the output size, but costs additional copy,
+    // so it is beneficial only if output does not fit into cache anyway.
+    // Note: store mode is NOT cleared when 'Clear' method is called.
+    void SetOutputStoreMode(int mode = osAuto);
+    // Returns true if output buffer of given size must be filled with non-temporal stores.
+    bool IsStreamingOutput(long long outputSize) const;
+
+    // Status of one string converted by ProcessBatch (synchronized with ConversionStatus).
+    enum BatchStatus {
+        bsSuccess = 0,          //the whole string converted
+        bsIncompleteData = 2,   //string is valid, but ends with incomplete code point
+        bsIncorrectData = 3,    //string contains invalid data, only the prefix before it is converted
+    };
+    // Converts a batch of many independent strings in one call.
+    // All the strings are stored contiguously in one input buffer (in the same way as in Apache Arrow):
+    //   i-th string occupies bytes [inputOffsets[i] .. inputOffsets[i+1]) of inputData, for i = 0, 1, ..., count-1.
+    // The converted strings are stored contiguously into outputData (without gaps), and the (count+1) offsets
+    // of them are saved into outputOffsets array, with outputOffsets[0] = 0.
+    // The output buffer must be sufficiently large to hold all converted data: its size must be at least
+    //   GetStreamsCount() * GetOutputBufferMinSize(inputOffsets[count] - inputOffsets[0])
+    // Each string is converted separately, as if it were the whole message (i.e. with hint = true).
+    // Status of every string is saved into statuses array (it must have count elements).
+    // If some string is invalid, then the error callback is used (if set), and other strings are converted anyway.
+    // Returns the number of strings converted with bsSuccess status.
+    // Multi-stream processor converts four strings simultaneously, one string per stream.
+    // This method neither uses nor changes the buffers, plugins and results set for 'Process' method.
+    // If processor collects statistics, then the counters are added to 'stats' (if it is not null).
+    int ProcessBatch(int count, const char *inputData, const int *inputOffsets, char *outputData, int outputSize, int *outputOffsets, unsigned char *statuses, Stats *stats = 0) const;
+
+    // Runtime statistics of a processor.
+    // It is collected only if the processor is created with statistics enabled (see WithStats in ProcessorSelector.h),
+    // so that usual processors have no overhead at all.
+    // Here "fast path" means the vectorized core, and "slow path" means DecodeTrivial / EncodeTrivial fallback.
+    // Note: if an error is met, then the bytes counters may include some data which was converted but discarded
+    // (e.g. data after the error in other streams of multi-stream decoder).
+    struct Stats {
+        long long fastBlocks;           //number of blocks converted by fast path (each block is one call of the core)
+        long long fastBytes;            //number of input bytes converted by fast path
+        long long slowCalls;            //number of calls of slow path
+        long long slowBytes;            //number of input bytes converted by slow path
+        long long errorCallbacks;       //number of calls of error callback
+        long long codePoints[4];        //number of converted code points with length (k+1) bytes in UTF-8
+        long long cycles;               //total number of CPU cycles spent in conversion (except error callbacks)
+        long long *lutHistogram;        //number of fast path lookups into each LUT entry (null if not set, see SetLutHistogram)
+
+        Stats() {
+            memset(this, 0, sizeof(*this));
+        }
+        //adds all counters of another statistics to this one (LUT histogram is not touched)
+        void Add(const Stats &other);
+    };
+    // Returns statistics accumulated by the stateful methods since the processor was created
+    // (or since the last ResetStats call), plus everything merged by MergeStats.
+    // Returns null if statistics is not enabled for the processor.
+    // Note: the const methods ('Process' with context and ProcessBatch) count into the Stats given to them.
+    const Stats *GetStats() const;
+    // Sets all counters of statistics to zero (LUT histogram is not touched).
+    void ResetStats();
+    // Adds counters from another statistics (e.g. collected by one thread) to statistics of processor.
+    void MergeStats(const Stats &other);
+    // Sets array where processor with statistics enabled counts lookups into each entry of its LUT.
+    // The array must contain at least MaxLutEntries elements, and it must be zeroed by caller.
+    // This is useful for profiling which part of the table is actually used on real data.
+    void SetLutHistogram(long long *counts);
+    static const int MaxLutEntries = 32768;
+
 private:
-    virtual bool _Process() = 0;
+    virtual bool _Process(Context &ctx) const = 0;
+    virtual int _ProcessBatch(int count, const char *inputData, const int *inputOffsets, char *outputData, int outputSize, int *outputOffsets, unsigned char *statuses, Stats *stats) const = 0;
 
     //plugins attached
     BasePlugin *plugins[MaxPluginsCount];
@@ -192,19 +328,34 @@ private:
     //error callback (if present)
     pfErrorCallback errorCallback;
     ctxErrorCallback errorContext;
+    //allocator set for processor (null means global one)
+    BaseAllocator *allocator;
+    //how to store output data (see OutputStoreMode)
+    int outputStoreMode;
+    //runtime statistics of stateful methods (if enabled)
+    bool statsEnabled;
+    Stats stats;
+    //state of conversion for the stateful methods
+    Context state;
 
 protected:  //accessed in implementations
     BaseBufferProcessor();
 
-    //input buffer
-    const char *inputBuffer;
-    int inputSize;
-    //output buffers (one per stream)
-    char *outputBuffer[MaxStreamsCount];
-    int outputSize[MaxStreamsCount];
-    //the hint: would next block be last
-    bool lastBlockMode;
-    //how much bytes were processed
-    int inputDone;
-    int outputDone[MaxStreamsCount];
+    // Computes a good size of input buffer, given how many output bytes are produced per input byte at most
+    // (the ratio is outputRatioNum / outputRatioDen). The input chunk and all its output should take about
+    // a quarter of L2 cache, leaving the rest for the lookup table. The result is a power of two.
+    static int GetCacheAwareBufferSize(int outputRatioNum, int outputRatioDen);
+
+    // Calls error callback for the invalid data at inputPtr (the data ends at inputEnd),
+    // the converted output must be written to outputPtr (the space ends at outputEnd).
+    // Returns true if callback has fixed the error, false if it has not or if there is no callback.
+    // The call is counted in 'stats' if it is not null.
+    bool CallErrorCallback(const char *&inputPtr, const char *inputEnd, char *&outputPtr, char *outputEnd, Stats *stats) const;
+
+    // Must be called in constructor of a processor which collects statistics.
+    // Implementations update statistics only if it is enabled by their template arguments,
+    // so processors without statistics have no code for it at all.
+    void EnableStats();
+    // Returns current value of CPU timestamp counter (for statistics).
+    static unsigned long long GetCycles();
 };
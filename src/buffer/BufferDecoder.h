@@ -27,6 +27,7 @@ FORCEINLINE const char *FindUtf8Border(const char *pSource) {
  * StreamsNum = 1, 4
  * Mode = fast, full, validate
  * OutputType = 2, 4
+ * CollectStats = false, true
  */
 
 enum DecoderMode {
@@ -36,27 +37,62 @@ enum DecoderMode {
     dmAllCount, //helper
 };
 
-template<int MaxBytes, int OutputType, int Mode, int StreamsNum>
+template<int MaxBytes, int OutputType, int Mode, int StreamsNum, bool CollectStats = false>
 class BufferDecoder : public BaseBufferProcessor {
 public:
     static const int StreamsNumber = DMAX(StreamsNum, 1);
 
 private:
     static const bool Validate = (Mode == dmValidate);
+    static const int MinBytesPerStream = 32;    //more than 16 after split
+    typedef DecoderLutEntry<Validate> LutEntry;
 
-    static FORCEINLINE bool ProcessSimple(const char *&inputPtr, const char *inputEnd, char *&outputPtr, bool isLastBlock) {
+    //lookup table (resolved once in constructor)
+    const LutEntry *lutTable;
+
+    //returns statistics to be updated (always null if it is not collected, so that counting code is removed)
+    static FORCEINLINE Stats *GetStatsPtr(Stats *stats) {
+        return CollectStats ? stats : 0;
+    }
+    //converts one block with fast path (and updates statistics)
+    static FORCEINLINE bool CoreStep(const char *&inputPtr, char *&outputPtr, const LutEntry *RESTRICT ptrTable, Stats *stats) {
+        const char *startPtr = inputPtr;
+        TIMING_FINE_START(FAST);
+        bool ok = DecoderCore<MaxBytes, Mode != dmFast, Mode == dmValidate, OutputType>()(inputPtr, outputPtr, ptrTable);
+        TIMING_FINE_END(FAST, inputPtr - startPtr);
+        if (CollectStats && stats && ok) {
+            stats->fastBlocks++;
+            stats->fastBytes += inputPtr - startPtr;
+            if (MaxBytes >= 2 && stats->lutHistogram)
+                stats->lutHistogram[GetDecoderLutIndex(startPtr)]++;
+        }
+        return ok;
+    }
+    //converts data with slow path (and updates statistics)
+    static FORCEINLINE bool TrivialStep(const char *&inputPtr, const char *inputEnd, char *&outputPtr, Stats *stats) {
+        const char *startPtr = inputPtr;
+        TIMING_FINE_START(SLOW);
+        bool ok = DecodeTrivial<OutputType>(inputPtr, inputEnd, outputPtr);
+        TIMING_FINE_END(SLOW, inputPtr - startPtr);
+        if (CollectStats && stats) {
+            stats->slowCalls++;
+            stats->slowBytes += inputPtr - startPtr;
+        }
+        return ok;
+    }
+
+    static FORCEINLINE bool ProcessSimple(const char *&inputPtr, const char *inputEnd, char *&outputPtr, bool isLastBlock, const LutEntry *RESTRICT ptrTable, Stats *stats) {
         bool ok = true;
-        const DecoderLutEntry<Validate> *RESTRICT ptrTable = DecoderLutTable<Validate>::GetArray();
         while (inputPtr <= inputEnd - 16) {
-            ok = DecoderCore<MaxBytes, Mode != dmFast, Mode == dmValidate, OutputType>()(inputPtr, outputPtr, ptrTable);
+            ok = CoreStep(inputPtr, outputPtr, ptrTable, stats);
             if (!ok) {
                 if (Mode != dmFast)
-                    ok = DecodeTrivial<OutputType>(inputPtr, inputPtr + 16, outputPtr);
+                    ok = TrivialStep(inputPtr, inputPtr + 16, outputPtr, stats);
                 if (!ok) break;
             }
         }
         if (isLastBlock)
-            ok = DecodeTrivial<OutputType>(inputPtr, inputEnd, outputPtr);
+            ok = TrivialStep(inputPtr, inputEnd, outputPtr, stats);
         return ok;
     }
 
@@ -66,39 +102,36 @@ private:
         for (int k = 1; k < StreamsNumber; k++)
             splits[k] = FindUtf8Border(buffer + uint32_t(k * size) / StreamsNumber);
     }
-public:
 
-    BufferDecoder() {
-        static_assert(MaxBytes >= 0 && MaxBytes <= 3, "MaxBytes must be between 0 and 3");
-        static_assert(OutputType == 2 || OutputType == 4, "OutputType must be either 2 or 4");
-        static_assert(Mode >= 0 && Mode <= dmAllCount, "Mode must be from DecoderMode enum");
-        static_assert(StreamsNum == 1 || StreamsNum == 4, "StreamsNum can be only 1 or 4");
-        static_assert(MaxBytes > 0 || StreamsNum == 1, "StreamNum must be 1 when MaxBytes = 0");
+    static FORCEINLINE bool ProcessWhole(const char *&inputPtr, const char *inputEnd, char *&outputPtr, const LutEntry *ptrTable, Stats *stats) {
+        if (MaxBytes > 0)
+            return ProcessSimple(inputPtr, inputEnd, outputPtr, true, ptrTable, stats);
+        else
+            return TrivialStep(inputPtr, inputEnd, outputPtr, stats);
     }
 
-    virtual int GetStreamsCount() const {
-        return StreamsNumber;
-    }
-    virtual int GetInputBufferRecommendedSize() const {
-        return 1<<16;   //64KB
-    }
-    virtual long long GetOutputBufferMinSize(long long inputSize) const {
-        return (inputSize / StreamsNumber + 4) * OutputType;
+    //converts the whole string as a separate message, returns BatchStatus
+    FORCEINLINE int ConvertString(const char *&inputPtr, const char *inputEnd, char *&outputPtr, char *outputEnd, Stats *stats) const {
+        bool ok;
+        do {
+            ok = ProcessWhole(inputPtr, inputEnd, outputPtr, lutTable, stats);
+        } while (!ok && CallErrorCallback(inputPtr, inputEnd, outputPtr, outputEnd, stats));
+        return !ok ? bsIncorrectData : inputPtr != inputEnd ? bsIncompleteData : bsSuccess;
     }
-
-    virtual bool _Process() {
+    //converts one chunk of input data (without statistics of code points)
+    FORCEINLINE bool ProcessChunk(Context &ctx) const {
         TIMING_START(DECODE);
-        static const int MinBytesPerStream = 32;    //more than 16 after split
-        if (StreamsNum > 1 && inputSize >= StreamsNum * MinBytesPerStream) {
+        if (StreamsNum > 1 && ctx.inputSize >= StreamsNum * MinBytesPerStream) {
             assert(StreamsNum == 4);
             const char *splits[StreamsNum + 1];
-            SplitRange(inputBuffer, inputSize, splits);
-            const DecoderLutEntry<Validate> *RESTRICT ptrTable = DecoderLutTable<Validate>::GetArray();
+            SplitRange(ctx.inputBuffer, ctx.inputSize, splits);
+            const LutEntry *RESTRICT ptrTable = lutTable;
+            Stats *ptrStats = GetStatsPtr(ctx.stats);
             #define STREAM_START(k) \
                 const char *inputStart##k = splits[k]; \
                 const char *inputEnd##k = splits[k+1]; \
                 const char *inputPtr##k = inputStart##k; \
-                char *outputPtr##k = outputBuffer[k]; \
+                char *outputPtr##k = ctx.outputBuffer[k]; \
                 bool ok##k;
             STREAM_START(0)
             STREAM_START(1)
@@ -113,7 +146,7 @@ public:
                 STREAM_CHECK(2);
                 STREAM_CHECK(3);
                 #define STREAM_STEP(k) \
-                    ok##k = DecoderCore<MaxBytes, Mode != dmFast, Mode == dmValidate, OutputType>()(inputPtr##k, outputPtr##k, ptrTable); \
+                    ok##k = CoreStep(inputPtr##k, outputPtr##k, ptrTable, ptrStats); \
                     if (!ok##k) goto slow;
                 STREAM_STEP(0);
                 STREAM_STEP(1);
@@ -122,7 +155,7 @@ public:
 slow:
                 #define STREAM_SLOW(k) \
                     if (!ok##k && Mode != dmFast) \
-                        ok##k = DecodeTrivial<OutputType>(inputPtr##k, inputPtr##k + 16, outputPtr##k); \
+                        ok##k = TrivialStep(inputPtr##k, inputPtr##k + 16, outputPtr##k, ptrStats); \
                     if (!ok##k) break;
                 STREAM_SLOW(0);
                 STREAM_SLOW(1);
@@ -130,9 +163,9 @@ slow:
                 STREAM_SLOW(3);
             }
             #define STREAM_FINISH(k) \
-                ok##k = ProcessSimple(inputPtr##k, inputEnd##k, outputPtr##k, true); \
-                inputDone = int(inputPtr##k - inputBuffer); \
-                outputDone[k] = int(outputPtr##k - outputBuffer[k]); \
+                ok##k = ProcessSimple(inputPtr##k, inputEnd##k, outputPtr##k, true, ptrTable, ptrStats); \
+                ctx.inputDone = int(inputPtr##k - ctx.inputBuffer); \
+                ctx.outputDone[k] = int(outputPtr##k - ctx.outputBuffer[k]); \
                 if (!ok##k || (k+1 < StreamsNum && inputPtr##k != inputEnd##k)) \
                     return false;
             STREAM_FINISH(0);
@@ -141,18 +174,151 @@ slow:
             STREAM_FINISH(3);
         }
         else {
-            const char *inputPtr = inputBuffer + inputDone;
-            char *outputPtr = outputBuffer[0] + outputDone[0];
+            const char *inputPtr = ctx.inputBuffer + ctx.inputDone;
+            char *outputPtr = ctx.outputBuffer[0] + ctx.outputDone[0];
             bool ok;
             if (MaxBytes > 0)
-                ok = ProcessSimple(inputPtr, inputBuffer + inputSize, outputPtr, lastBlockMode);
+                ok = ProcessSimple(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, ctx.lastBlockMode, lutTable, GetStatsPtr(ctx.stats));
             else
-                ok = DecodeTrivial<OutputType>(inputPtr, inputBuffer + inputSize, outputPtr);
-            inputDone = int(inputPtr - inputBuffer);
-            outputDone[0] = int(outputPtr - outputBuffer[0]);
+                ok = TrivialStep(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, GetStatsPtr(ctx.stats));
+            ctx.inputDone = int(inputPtr - ctx.inputBuffer);
+            ctx.outputDone[0] = int(outputPtr - ctx.outputBuffer[0]);
             if (!ok) return false;
         }
-        TIMING_END(DECODE, inputDone);
+        TIMING_END(DECODE, ctx.inputDone);
         return true;
     }
+public:
+
+    BufferDecoder() {
+        static_assert(MaxBytes >= 0 && MaxBytes <= 3, "MaxBytes must be between 0 and 3");
+        static_assert(OutputType == 2 || OutputType == 4, "OutputType must be either 2 or 4");
+        static_assert(Mode >= 0 && Mode <= dmAllCount, "Mode must be from DecoderMode enum");
+        static_assert(StreamsNum == 1 || StreamsNum == 4, "StreamsNum can be only 1 or 4");
+        static_assert(MaxBytes > 0 || StreamsNum == 1, "StreamNum must be 1 when MaxBytes = 0");
+        lutTable = DecoderLutTable<Validate>::GetArray();
+        if (CollectStats)
+            EnableStats();
+    }
+
+    // Converts the whole message in a single stream, as if it were passed to Process with hint = true.
+    // No processor object is needed: no buffers, no plugins, no error callback, no virtual calls.
+    // Output space must be at least GetOutputMaxSize(inputEnd - inputPtr) bytes.
+    // Returns false if invalid data is met (pointers are left at the first invalid code point).
+    static FORCEINLINE bool ProcessWhole(const char *&inputPtr, const char *inputEnd, char *&outputPtr) {
+        return ProcessWhole(inputPtr, inputEnd, outputPtr, DecoderLutTable<Validate>::GetArray(), 0);
+    }
+    // Returns how many bytes can be written when converting inputSize bytes in a single stream.
+    static FORCEINLINE long long GetOutputMaxSize(long long inputSize) {
+        return (inputSize + 4) * OutputType;
+    }
+
+    virtual int GetStreamsCount() const {
+        return StreamsNumber;
+    }
+    virtual int GetInputBufferRecommendedSize() const {
+        //every input byte produces at most one output code unit
+        return GetCacheAwareBufferSize(OutputType, 1);
+    }
+    virtual long long GetOutputBufferMinSize(long long inputSize) const {
+        long long streamSize = inputSize / StreamsNumber;
+        //small input is converted in single stream (see _Process)
+        if (StreamsNum > 1)
+            streamSize = DMAX(streamSize, DMIN(inputSize, StreamsNum * MinBytesPerStream));
+        return GetOutputMaxSize(streamSize);
+    }
+
+    virtual bool _Process(Context &ctx) const {
+        Stats *stats = GetStatsPtr(ctx.stats);
+        unsigned long long startTime = (stats ? GetCycles() : 0);
+        const char *startPtr = ctx.inputBuffer + ctx.inputDone;
+        bool ok = ProcessChunk(ctx);
+        if (stats) {
+            CountCodePointLengths<1>(startPtr, ctx.inputBuffer + ctx.inputDone, stats->codePoints);
+            stats->cycles += GetCycles() - startTime;
+        }
+        return ok;
+    }
+
+    virtual int _ProcessBatch(int count, const char *inputData, const int *inputOffsets, char *outputData, int outputSize, int *outputOffsets, unsigned char *statuses, Stats *batchStats) const {
+        Stats *stats = GetStatsPtr(batchStats);
+        unsigned long long startTime = (stats ? GetCycles() : 0);
+        char *outputPtr = outputData;
+        char *outputEnd = outputData + outputSize;
+        int successCount = 0;
+        int idx = 0;
+        outputOffsets[0] = 0;
+
+        if (StreamsNum > 1) {
+            assert(StreamsNum == 4);
+            const LutEntry *RESTRICT ptrTable = lutTable;
+            Stats *ptrStats = stats;
+            //every group of four strings is converted simultaneously, one string per stream
+            //each stream writes into its own part of output buffer, large enough for any input,
+            //then the converted strings are moved together
+            for (; idx + 4 <= count; idx += 4) {
+                const char *inputPtr[4], *inputEnd[4];
+                char *outputStart[4], *outputPtrs[4];
+                bool ok[4];
+                for (int k = 0; k < 4; k++) {
+                    inputPtr[k] = inputData + inputOffsets[idx + k];
+                    inputEnd[k] = inputData + inputOffsets[idx + k + 1];
+                    outputStart[k] = (k == 0 ? outputPtr : outputStart[k-1] + (inputEnd[k-1] - (inputData + inputOffsets[idx + k-1])) * OutputType);
+                    outputPtrs[k] = outputStart[k];
+                    ok[k] = true;
+                }
+                while (1) {
+                    #define BATCH_CHECK(k) \
+                        if (inputPtr[k] > inputEnd[k] - 16) \
+                            break;
+                    BATCH_CHECK(0);
+                    BATCH_CHECK(1);
+                    BATCH_CHECK(2);
+                    BATCH_CHECK(3);
+                    #define BATCH_STEP(k) \
+                        ok[k] = CoreStep(inputPtr[k], outputPtrs[k], ptrTable, ptrStats); \
+                        if (!ok[k]) goto slow;
+                    BATCH_STEP(0);
+                    BATCH_STEP(1);
+                    BATCH_STEP(2);
+                    BATCH_STEP(3);
+slow:
+                    #define BATCH_SLOW(k) \
+                        if (!ok[k] && Mode != dmFast) \
+                            ok[k] = TrivialStep(inputPtr[k], inputPtr[k] + 16, outputPtrs[k], ptrStats); \
+                        if (!ok[k]) break;
+                    BATCH_SLOW(0);
+                    BATCH_SLOW(1);
+                    BATCH_SLOW(2);
+                    BATCH_SLOW(3);
+                }
+                for (int k = 0; k < 4; k++) {
+                    int status = ConvertString(inputPtr[k], inputEnd[k], outputPtrs[k], outputEnd, stats);
+                    if (stats)
+                        CountCodePointLengths<1>(inputData + inputOffsets[idx + k], inputPtr[k], stats->codePoints);
+                    int bytes = int(outputPtrs[k] - outputStart[k]);
+                    if (k > 0)
+                        memmove(outputPtr, outputStart[k], bytes);
+                    outputPtr += bytes;
+                    outputOffsets[idx + k + 1] = int(outputPtr - outputData);
+                    statuses[idx + k] = (unsigned char)status;
+                    successCount += (status == bsSuccess);
+                }
+            }
+        }
+
+        for (; idx < count; idx++) {
+            const char *inputPtr = inputData + inputOffsets[idx];
+            int status = ConvertString(inputPtr, inputData + inputOffsets[idx + 1], outputPtr, outputEnd, stats);
+            if (stats)
+                CountCodePointLengths<1>(inputData + inputOffsets[idx], inputPtr, stats->codePoints);
+            outputOffsets[idx + 1] = int(outputPtr - outputData);
+            statuses[idx] = (unsigned char)status;
+            successCount += (status == bsSuccess);
+        }
+
+        if (stats)
+            stats->cycles += GetCycles() - startTime;
+        return successCount;
+    }
 };
@@ -14,6 +14,7 @@
  * UnrollNum = 1, 4
  * Mode = fast, full, validate
  * InputType = 2, 4
+ * CollectStats = false, true
  */
 
 enum EncoderMode {
@@ -24,7 +25,7 @@ enum EncoderMode {
 };
 //Note: emValidate and emFull are completely equivalent
 
-template<int MaxBytes, int InputType, int Mode, int UnrollNum>
+template<int MaxBytes, int InputType, int Mode, int UnrollNum, bool CollectStats = false>
 class BufferEncoder : public BaseBufferProcessor {
 public:
     static const int StreamsNumber = 1;
@@ -34,22 +35,111 @@ private:
     static const int InputUnrollChunk = InputMinChunk * (UnrollNum > 0 ? UnrollNum : 1);
     static const bool ThreeBytes = (MaxBytes >= 3);
 
-    static FORCEINLINE bool ProcessSimple(const char *&inputPtr, const char *inputEnd, char *&outputPtr, bool isLastBlock) {
+    //lookup table (resolved once in constructor)
+    const EncoderLutEntry *lutTable;
+
+    //returns statistics to be updated (always null if it is not collected, so that counting code is removed)
+    static FORCEINLINE Stats *GetStatsPtr(Stats *stats) {
+        return CollectStats ? stats : 0;
+    }
+    //converts one block with fast path (and updates statistics)
+    static FORCEINLINE bool CoreStep(const char *&inputPtr, char *&outputPtr, const EncoderLutEntry *RESTRICT ptrTable, Stats *stats) {
+        const char *startPtr = inputPtr;
+        TIMING_FINE_START(FAST);
+        bool ok = EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable);
+        TIMING_FINE_END(FAST, inputPtr - startPtr);
+        if (CollectStats && stats && ok) {
+            stats->fastBlocks++;
+            stats->fastBytes += inputPtr - startPtr;
+            if (MaxBytes >= 2 && stats->lutHistogram) {
+                int indices[2];
+                int cnt = GetEncoderLutIndices<(MaxBytes >= 2 ? MaxBytes : 2), InputType>(startPtr, indices);
+                for (int i = 0; i < cnt; i++)
+                    stats->lutHistogram[indices[i]]++;
+            }
+        }
+        return ok;
+    }
+    //converts data with slow path (and updates statistics)
+    static FORCEINLINE bool TrivialStep(const char *&inputPtr, const char *inputEnd, char *&outputPtr, Stats *stats) {
+        const char *startPtr = inputPtr;
+        TIMING_FINE_START(SLOW);
+        bool ok = EncodeTrivial<InputType>(inputPtr, inputEnd, outputPtr);
+        TIMING_FINE_END(SLOW, inputPtr - startPtr);
+        if (CollectStats && stats) {
+            stats->slowCalls++;
+            stats->slowBytes += inputPtr - startPtr;
+        }
+        return ok;
+    }
+
+    static FORCEINLINE bool ProcessSimple(const char *&inputPtr, const char *inputEnd, char *&outputPtr, bool isLastBlock, const EncoderLutEntry *RESTRICT ptrTable, Stats *stats) {
         bool ok = true;
-        const EncoderLutEntry *RESTRICT ptrTable = EncoderLutTable<ThreeBytes>::GetArray();
         while (inputPtr <= inputEnd - InputMinChunk) {
-            ok = EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable);
+            ok = CoreStep(inputPtr, outputPtr, ptrTable, stats);
             if (!ok) {
                 if (Mode != dmFast)
-                    ok = EncodeTrivial<InputType>(inputPtr, inputPtr + InputMinChunk, outputPtr);
+                    ok = TrivialStep(inputPtr, inputPtr + InputMinChunk, outputPtr, stats);
                 if (!ok) break;
             }
         }
         if (isLastBlock)
-            ok = EncodeTrivial<InputType>(inputPtr, inputEnd, outputPtr);
+            ok = TrivialStep(inputPtr, inputEnd, outputPtr, stats);
         return ok;
     }
 
+    static FORCEINLINE void ProcessUnrolled(const char *&inputPtr, const char *inputEnd, char *&outputPtr, const EncoderLutEntry *RESTRICT ptrTable, Stats *stats) {
+        long long blocks = (inputEnd - inputPtr) / InputUnrollChunk;
+        for (long long i = 0; i < blocks; i++) {
+            bool ok = 
+                CoreStep(inputPtr, outputPtr, ptrTable, stats) &&
+                CoreStep(inputPtr, outputPtr, ptrTable, stats) &&
+                CoreStep(inputPtr, outputPtr, ptrTable, stats) &&
+                CoreStep(inputPtr, outputPtr, ptrTable, stats);
+            if (!ok) break;
+        }
+    }
+
+    static FORCEINLINE bool ProcessWhole(const char *&inputPtr, const char *inputEnd, char *&outputPtr, const EncoderLutEntry *ptrTable, Stats *stats) {
+        if (UnrollNum == 4)
+            ProcessUnrolled(inputPtr, inputEnd, outputPtr, ptrTable, stats);
+        if (MaxBytes > 0)
+            return ProcessSimple(inputPtr, inputEnd, outputPtr, true, ptrTable, stats);
+        else
+            return TrivialStep(inputPtr, inputEnd, outputPtr, stats);
+    }
+
+    //converts the whole string as a separate message, returns BatchStatus
+    FORCEINLINE int ConvertString(const char *&inputPtr, const char *inputEnd, char *&outputPtr, char *outputEnd, Stats *stats) const {
+        bool ok;
+        do {
+            ok = ProcessWhole(inputPtr, inputEnd, outputPtr, lutTable, stats);
+        } while (!ok && CallErrorCallback(inputPtr, inputEnd, outputPtr, outputEnd, stats));
+        return !ok ? bsIncorrectData : inputPtr != inputEnd ? bsIncompleteData : bsSuccess;
+    }
+
+    //converts one chunk of input data (without statistics of code points)
+    FORCEINLINE bool ProcessChunk(Context &ctx) const {
+        TIMING_START(ENCODE);
+
+        const char *inputPtr = ctx.inputBuffer + ctx.inputDone;
+        char *outputPtr = ctx.outputBuffer[0] + ctx.outputDone[0];
+
+        if (UnrollNum == 4)
+            ProcessUnrolled(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, lutTable, GetStatsPtr(ctx.stats));
+
+        bool ok;
+        if (MaxBytes > 0)
+            ok = ProcessSimple(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, ctx.lastBlockMode, lutTable, GetStatsPtr(ctx.stats));
+        else
+            ok = TrivialStep(inputPtr, ctx.inputBuffer + ctx.inputSize, outputPtr, GetStatsPtr(ctx.stats));
+        ctx.inputDone = int(inputPtr - ctx.inputBuffer);
+        ctx.outputDone[0] = int(outputPtr - ctx.outputBuffer[0]);
+        if (!ok) return false;
+
+        TIMING_END(ENCODE, ctx.inputDone);
+        return true;
+    }
 public:
 
     BufferEncoder() {
@@ -58,47 +148,64 @@ public:
         static_assert(Mode >= 0 && Mode <= emAllCount, "Mode must be from EncoderMode enum");
         static_assert(UnrollNum == 1 || UnrollNum == 4, "UnrollNum must be 1 or 4");
         static_assert(MaxBytes > 0 || UnrollNum == 1, "UnrollNum must 1 when MaxBytes = 0");
+        lutTable = EncoderLutTable<ThreeBytes>::GetArray();
+        if (CollectStats)
+            EnableStats();
     }
 
+    // Converts the whole message, as if it were passed to Process with hint = true.
+    // No processor object is needed: no buffers, no plugins, no error callback, no virtual calls.
+    // Output space must be at least GetOutputMaxSize(inputEnd - inputPtr) bytes.
+    // Returns false if invalid data is met (pointers are left at the first invalid code point).
+    static FORCEINLINE bool ProcessWhole(const char *&inputPtr, const char *inputEnd, char *&outputPtr) {
+        return ProcessWhole(inputPtr, inputEnd, outputPtr, EncoderLutTable<ThreeBytes>::GetArray(), 0);
+    }
+    // Returns how many bytes can be written when converting inputSize bytes.
+    static FORCEINLINE long long GetOutputMaxSize(long long inputSize) {
+        return (inputSize / InputType) * (InputType == 2 ? 3 : 4) + 16;
+    }
 
     virtual int GetStreamsCount() const {
         return StreamsNumber;
     }
     virtual int GetInputBufferRecommendedSize() const {
-        return 1<<16;   //64KB
+        //every input code unit produces at most 3 bytes (UTF-16) or 4 bytes (UTF-32)
+        return GetCacheAwareBufferSize(InputType == 2 ? 3 : 4, InputType);
     }
     virtual long long GetOutputBufferMinSize(long long inputSize) const {
-        return (inputSize / InputType) * (InputType == 2 ? 3 : 4) + 16;
+        return GetOutputMaxSize(inputSize);
     }
 
-    virtual bool _Process() {
-        TIMING_START(ENCODE);
-
-        const char *inputPtr = inputBuffer + inputDone;
-        char *outputPtr = outputBuffer[0] + outputDone[0];
-
-        if (UnrollNum == 4) {
-            const EncoderLutEntry *RESTRICT ptrTable = EncoderLutTable<ThreeBytes>::GetArray();
-            for (int i = 0; i < inputSize / InputUnrollChunk; i++) {
-                bool ok = 
-                    EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable) &&
-                    EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable) &&
-                    EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable) &&
-                    EncoderCore<MaxBytes, Mode != dmFast, InputType>()(inputPtr, outputPtr, ptrTable);
-                if (!ok) break;
-            }
+    virtual bool _Process(Context &ctx) const {
+        Stats *stats = GetStatsPtr(ctx.stats);
+        unsigned long long startTime = (stats ? GetCycles() : 0);
+        const char *startPtr = ctx.inputBuffer + ctx.inputDone;
+        bool ok = ProcessChunk(ctx);
+        if (stats) {
+            CountCodePointLengths<InputType>(startPtr, ctx.inputBuffer + ctx.inputDone, stats->codePoints);
+            stats->cycles += GetCycles() - startTime;
         }
+        return ok;
+    }
 
-        bool ok;
-        if (MaxBytes > 0)
-            ok = ProcessSimple(inputPtr, inputBuffer + inputSize, outputPtr, lastBlockMode);
-        else
-            ok = EncodeTrivial<InputType>(inputPtr, inputBuffer + inputSize, outputPtr);
-        inputDone = int(inputPtr - inputBuffer);
-        outputDone[0] = int(outputPtr - outputBuffer[0]);
-        if (!ok) return false;
-
-        TIMING_END(ENCODE, inputDone);
-        return true;
+    virtual int _ProcessBatch(int count, const char *inputData, const int *inputOffsets, char *outputData, int outputSize, int *outputOffsets, unsigned char *statuses, Stats *batchStats) const {
+        Stats *stats = GetStatsPtr(batchStats);
+        unsigned long long startTime = (stats ? GetCycles() : 0);
+        char *outputPtr = outputData;
+        char *outputEnd = outputData + outputSize;
+        int successCount = 0;
+        outputOffsets[0] = 0;
+        for (int idx = 0; idx < count; idx++) {
+            const char *inputPtr = inputData + inputOffsets[idx];
+            int status = ConvertString(inputPtr, inputData + inputOffsets[idx + 1], outputPtr, outputEnd, stats);
+            if (stats)
+                CountCodePointLengths<InputType>(inputData + inputOffsets[idx], inputPtr, stats->codePoints);
+            outputOffsets[idx + 1] = int(outputPtr - outputData);
+            statuses[idx] = (unsigned char)status;
+            successCount += (status == bsSuccess);
+        }
+        if (stats)
+            stats->cycles += GetCycles() - startTime;
+        return successCount;
     }
 };
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "buffer/BaseBufferProcessor.h"
+#include "base/Allocator.h"
+#include "base/PerfDefs.h"
+#include "base/Crc32c.h"
+#include "base/StreamingMemcpy.h"
 
 // Base class for all plugins (they can be attached to BaseBufferProcessor).
 class BasePlugin {
@@ -17,6 +21,7 @@ class InputPlugin : public BasePlugin {};
 //plugins intended to simplify setting output data
 class OutputPlugin : public BasePlugin {};
 //Note that you can independently choose one input plugin and one output plugin
+//Other plugins (e.g. OutputChecksum) can be attached in addition to them
 
 
 
@@ -41,23 +46,32 @@ class ContiguousInput : public InputPlugin {
     long long srcDone;
     int chunkSize;
     bool finished;
+    bool lastBlock;
 
 public:
     //takes pointer and size of contiguous input buffer to be converted
-    ContiguousInput(BaseBufferProcessor &owner, const char *buffer, long long size) : processor(&owner) {
+    //if "bufferSize" is positive, it overrides the recommended size of chunks
+    ContiguousInput(BaseBufferProcessor &owner, const char *buffer, long long size, int bufferSize = 0) : processor(&owner) {
+        chunkSize = (bufferSize > 0 ? bufferSize : processor->GetInputBufferRecommendedSize());
+        Reset(buffer, size);
+        processor->AddPlugin(*this);
+    }
+    //starts conversion of another contiguous input buffer from scratch
+    //if "isLastBlock" is false, then the buffer is not the end of data (e.g. a window of file):
+    //processor may leave a few bytes at its end unconverted (see hint in BaseBufferProcessor::SetHint)
+    void Reset(const char *buffer, long long size, bool isLastBlock = true) {
         srcBuffer = buffer;
         srcSize = size;
         srcDone = 0;
-        chunkSize = processor->GetInputBufferRecommendedSize();
         finished = (srcSize == 0);
-        processor->AddPlugin(*this);
+        lastBlock = isLastBlock;
     }
     virtual void Pre() {
         assert(!finished);
         int bytes = GetNextChunkSize();
         processor->SetInputBuffer(srcBuffer + srcDone, bytes);
         finished = (srcDone + bytes == srcSize);
-        processor->SetHint(finished);
+        processor->SetHint(finished && lastBlock);
     }
     virtual void Post() {
         srcDone += processor->GetInputDoneSize();
@@ -91,6 +105,7 @@ public:
 
 // A plugin which helps to interactively put input data into internal buffer.
 // It owns a dynamically allocated buffer where the user puts his input data.
+// The buffer is taken from the allocator of processor (see BaseBufferProcessor::SetAllocator).
 // During each 'Process' call, all the contents of the buffer are processed.
 // Unconverted data (i.e. incomplete code point) at the end of the buffer is
 // automatically moved to the beginning of the buffer.
@@ -118,6 +133,7 @@ public:
 //
 class InteractiveInput : public InputPlugin {
     BaseBufferProcessor *processor;
+    BaseAllocator *allocator;
     char *inputBuffer;
     int inputSize;
     int inputSet;
@@ -125,15 +141,17 @@ class InteractiveInput : public InputPlugin {
     long long totalSizeDone;
 
 public:
-    InteractiveInput(BaseBufferProcessor &owner) : processor(&owner) {
-        inputSize = processor->GetInputBufferRecommendedSize();
-        inputBuffer = new char[inputSize];
+    //if "bufferSize" is positive, it overrides the recommended size of internal buffer
+    InteractiveInput(BaseBufferProcessor &owner, int bufferSize = 0) : processor(&owner) {
+        inputSize = (bufferSize > 0 ? bufferSize : processor->GetInputBufferRecommendedSize());
+        allocator = &processor->GetAllocator();
+        inputBuffer = (char*)allocator->Allocate(inputSize, CACHE_LINE);
         inputSet = 0;
         totalSizeDone = 0;
         processor->AddPlugin(*this);
     }
     ~InteractiveInput() {
-        delete[] inputBuffer;
+        allocator->Deallocate(inputBuffer, inputSize, CACHE_LINE);
     }
     //returns pointer and size of a subbuffer where new data must be placed
     //you can write to there K bytes of new input data (for any K <= "size")
@@ -186,15 +204,20 @@ public:
 //          +-----------------|------------+
 //
 // If multi-stream processor is used, then conversion results are first saved into internal buffers,
-// and then automatically copied into the user's byte array.
+// and then automatically copied into the user's byte array (internal buffers are taken from processor's allocator).
 // Note that this means minor performance loss due to additional memcpy of the output data.
 // You do not need to do anything special to handle this case, no difference is visible from the outside.
+//
+// If processor says that output must be streamed (see BaseBufferProcessor::SetOutputStoreMode),
+// then internal buffer is used in single-stream case too, and data is copied from internal buffers
+// into the user's byte array with non-temporal stores, so that it does not pollute caches.
 //     
 // Note that the static method ContiguousOutput::GetMaxOutputSize can be used without plugin
 // in order to see which size of output buffer is needed to surely accomodate result of conversion.
 //
 class ContiguousOutput : public OutputPlugin {
     BaseBufferProcessor *processor;
+    BaseAllocator *allocator;
     char *dstBuffer;
     long long dstSize;
     long long dstDone;
@@ -202,6 +225,13 @@ class ContiguousOutput : public OutputPlugin {
 
     int streamsCnt, streamOutputSize;
     char *multiBuffer[BaseBufferProcessor::MaxStreamsCount];
+    bool streaming;
+    int allocatedCnt;   //how many internal buffers are allocated
+
+    void AllocateBuffers(int count) {
+        for (; allocatedCnt < count; allocatedCnt++)
+            multiBuffer[allocatedCnt] = (char*)allocator->Allocate(streamOutputSize, CACHE_LINE);
+    }
 
 public:
     //returns minimal size of contiguous output buffer, such that for any input data of size "inputSize":
@@ -212,27 +242,37 @@ public:
         return processor.GetStreamsCount() * processor.GetOutputBufferMinSize(inputSize);
     }
     //takes pointer and size of contiguous output buffer where the result of conversion must be saved
-    ContiguousOutput(BaseBufferProcessor &owner, char *buffer, long long size) : processor(&owner) {
-        dstBuffer = buffer;
-        dstSize = size;
-        dstDone = 0;
+    //if "inputBufferSize" is positive, it must be equal to the chunk size used by input plugin
+    ContiguousOutput(BaseBufferProcessor &owner, char *buffer, long long size, int inputBufferSize = 0) : processor(&owner) {
         streamsCnt = processor->GetStreamsCount();
-        streamOutputSize = 0;
         maxSize = processor->GetBufferMaxSize();
-        if (streamsCnt > 1) {
-            streamOutputSize = (int)processor->GetOutputBufferMinSize(processor->GetInputBufferRecommendedSize());
-            for (int i = 0; i < streamsCnt; i++)
-                multiBuffer[i] = new char[streamOutputSize];
-        }
+        allocator = &processor->GetAllocator();
+        int inputSize = (inputBufferSize > 0 ? inputBufferSize : processor->GetInputBufferRecommendedSize());
+        streamOutputSize = (int)processor->GetOutputBufferMinSize(inputSize);
+        allocatedCnt = 0;
+        if (streamsCnt > 1)
+            AllocateBuffers(streamsCnt);
+        Reset(buffer, size);
         processor->AddPlugin(*this);
     }
+    //starts saving output into another contiguous buffer from scratch
+    //note: internal buffers (in multi-stream case) are reused
+    //if the buffer is only a part of the whole output (e.g. a window of file), then "totalSize" should be
+    //the size of the whole output: it is used to choose between ordinary and streaming stores
+    void Reset(char *buffer, long long size, long long totalSize = 0) {
+        dstBuffer = buffer;
+        dstSize = size;
+        dstDone = 0;
+        streaming = processor->IsStreamingOutput(DMAX(size, totalSize));
+        if (streaming)
+            AllocateBuffers(streamsCnt);    //single-stream case: allocated on first use
+    }
     ~ContiguousOutput() {
-        if (streamsCnt > 1)
-            for (int i = 0; i < streamsCnt; i++)
-                delete[] multiBuffer[i];
+        for (int i = 0; i < allocatedCnt; i++)
+            allocator->Deallocate(multiBuffer[i], streamOutputSize, CACHE_LINE);
     }
     virtual void Pre() {
-        if (streamsCnt > 1) {
+        if (streamsCnt > 1 || streaming) {
             for (int i = 0; i < streamsCnt; i++)
                 processor->SetOutputBuffer(multiBuffer[i], streamOutputSize, i);
         }
@@ -244,17 +284,24 @@ public:
         }
     }
     virtual void Post() {
-        if (streamsCnt > 1) {
+        if (streamsCnt > 1 || streaming) {
             for (int i = 0; i < streamsCnt; i++) {
                 int done = processor->GetOutputDoneSize(i);
                 assert(dstDone + done <= dstSize);
-                memcpy(dstBuffer + dstDone, multiBuffer[i], done);
+                if (streaming)
+                    StreamingMemcpy(dstBuffer + dstDone, multiBuffer[i], done);
+                else
+                    memcpy(dstBuffer + dstDone, multiBuffer[i], done);
                 dstDone += done;
             }
         }
         else
             dstDone += processor->GetOutputDoneSize();
     }
+    //returns true if output is saved with non-temporal stores (see BaseBufferProcessor::SetOutputStoreMode)
+    bool IsStreaming() const {
+        return streaming;
+    }
     //returns how many bytes of output data already saved (in the prefix of the buffer)
     long long GetFilledOutputSize() const {
         return dstDone;
@@ -268,6 +315,7 @@ public:
 
 // A plugin which helps to interactively consume conversion results from internal buffer(s).
 // It owns dynamically allocated buffer (or buffers) which receive output data.
+// The buffers are taken from the allocator of processor (see BaseBufferProcessor::SetAllocator).
 // During each 'Process' call, the conversion results are stored into this buffer(s).
 // User must read all the contents from this buffer(s) prior to next 'Process' call.
 //
@@ -290,22 +338,26 @@ public:
 //
 class InteractiveOutput : public OutputPlugin {
     BaseBufferProcessor *processor;
+    BaseAllocator *allocator;
     int streamsCnt, streamOutputSize;
     char *multiBuffer[BaseBufferProcessor::MaxStreamsCount];
     long long totalSizeDone;
 
 public:
-    InteractiveOutput(BaseBufferProcessor &owner) : processor(&owner) {
+    //if "inputBufferSize" is positive, it must be equal to the buffer size used by input plugin
+    InteractiveOutput(BaseBufferProcessor &owner, int inputBufferSize = 0) : processor(&owner) {
         streamsCnt = processor->GetStreamsCount();
-        streamOutputSize = (int)processor->GetOutputBufferMinSize(processor->GetInputBufferRecommendedSize());
+        int inputSize = (inputBufferSize > 0 ? inputBufferSize : processor->GetInputBufferRecommendedSize());
+        streamOutputSize = (int)processor->GetOutputBufferMinSize(inputSize);
+        allocator = &processor->GetAllocator();
         for (int i = 0; i < streamsCnt; i++)
-            multiBuffer[i] = new char[streamOutputSize];
+            multiBuffer[i] = (char*)allocator->Allocate(streamOutputSize, CACHE_LINE);
         totalSizeDone = 0;
         processor->AddPlugin(*this);
     }
     ~InteractiveOutput() {
         for (int i = 0; i < streamsCnt; i++)
-            delete[] multiBuffer[i];
+            allocator->Deallocate(multiBuffer[i], streamOutputSize, CACHE_LINE);
     }
     virtual void Pre() {
         for (int i = 0; i < streamsCnt; i++)
@@ -332,3 +384,51 @@ public:
         return totalSizeDone;
     }
 };
+
+
+// A plugin which computes CRC-32C checksum of all the output data (see base/Crc32c.h).
+// After each 'Process' call, it hashes the data written by processor into output buffer(s),
+// while it is still in L1/L2 cache, so that no separate pass over the whole output is needed.
+// It can be attached together with any input and output plugins (in any order),
+// since it does not set any buffers, but only reads output of the last 'Process' call.
+//
+// The following sample shows how to compute checksum of every message converted by a session:
+//      ConversionSession session(processor);
+//      OutputChecksum checksum(processor);     //must be created after the session
+//      for (each message) {
+//          checksum.Reset();
+//          session.Convert(...);
+//          uint32_t crc = checksum.GetChecksum();
+//      }
+//
+class OutputChecksum : public BasePlugin {
+    BaseBufferProcessor *processor;
+    uint32_t crc;
+    long long totalSize;
+
+public:
+    OutputChecksum(BaseBufferProcessor &owner) : processor(&owner) {
+        Reset();
+        processor->AddPlugin(*this);
+    }
+    //starts computing checksum of another output from scratch
+    void Reset() {
+        crc = 0;
+        totalSize = 0;
+    }
+    virtual void Post() {
+        for (int i = 0; i < processor->GetStreamsCount(); i++) {
+            int done = processor->GetOutputDoneSize(i);
+            crc = Crc32c(crc, processor->GetOutputBuffer(i), done);
+            totalSize += done;
+        }
+    }
+    //returns CRC-32C of all the output data produced since creation (or last Reset call)
+    uint32_t GetChecksum() const {
+        return crc;
+    }
+    //returns the total number of bytes covered by checksum
+    long long GetChecksummedSize() const {
+        return totalSize;
+    }
+};
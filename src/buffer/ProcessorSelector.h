@@ -82,6 +82,10 @@ enum ConversionMode {
 // Two ready-to-use callbacks are included: skipping code units or replacing them with 0xFFFD replacement code point.
 // Note that error correction works even slower than the slow path, and it won't work in cmFast and cmFull modes.
 //
+// The WithStats argument enables collection of runtime statistics (see BaseBufferProcessor::GetStats).
+// It shows e.g. how much data goes through the fast path, which helps to choose MaxBytes properly.
+// Collecting statistics slows conversion down, so it is disabled by default (and then has no overhead at all).
+//
 // Here is an example of enabling the 'skip-code-unit' error correction:
 //   typedef ProcessorSelector<dfUtf8, dfUtf16> ConversionDirection;
 //   typedef ConversionDirection::WithOptions<cmValidate, 2>::Processor MyProcessor;
@@ -99,12 +103,12 @@ struct ProcessorSelector {
     static_assert(DstFormat >= 0 && DstFormat < dfUtfCount, "Unsupported format");
     static_assert((SrcFormat == dfUtf8) != (DstFormat == dfUtf8), "Supported only conversions: from UTF-8 or to UTF-8");
 
-    template<int Mode = cmValidate, int MaxBytes = 3, int SpeedMult = 1>
+    template<int Mode = cmValidate, int MaxBytes = 3, int SpeedMult = 1, bool WithStats = false>
     struct WithOptions {
         // Type of corresponding processor, can be created as "new ...::Processor();"
         typedef typename TernaryOperator<SrcFormat == dfUtf8,
-            BufferDecoder<MaxBytes, (DstFormat == dfUtf32 ? 4 : 2), Mode, SpeedMult>,
-            BufferEncoder<MaxBytes, (SrcFormat == dfUtf32 ? 4 : 2), Mode, SpeedMult>
+            BufferDecoder<MaxBytes, (DstFormat == dfUtf32 ? 4 : 2), Mode, SpeedMult, WithStats>,
+            BufferEncoder<MaxBytes, (SrcFormat == dfUtf32 ? 4 : 2), Mode, SpeedMult, WithStats>
         >::Type Processor;
 
         // A helper for creating processor with error correction or without it.
@@ -172,9 +176,9 @@ bool ProcessorSelector<SrcFormat, DstFormat>::OnErrorSetReplacementChars(
 }
 
 template<int SrcFormat, int DstFormat>
-template<int Mode, int MaxBytes, int SpeedMult>
-typename ProcessorSelector<SrcFormat, DstFormat>::template WithOptions<Mode, MaxBytes, SpeedMult>::Processor *
-ProcessorSelector<SrcFormat, DstFormat>::WithOptions<Mode, MaxBytes, SpeedMult>::Create(int *errorCounter) {
+template<int Mode, int MaxBytes, int SpeedMult, bool WithStats>
+typename ProcessorSelector<SrcFormat, DstFormat>::template WithOptions<Mode, MaxBytes, SpeedMult, WithStats>::Processor *
+ProcessorSelector<SrcFormat, DstFormat>::WithOptions<Mode, MaxBytes, SpeedMult, WithStats>::Create(int *errorCounter) {
     Processor *result = new Processor();
     if (errorCounter)
         result->SetErrorCallback(OnErrorSetReplacementChars, errorCounter);
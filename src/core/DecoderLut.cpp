@@ -1,4 +1,5 @@
 #include "core/DecoderLut.h"
+#include "base/Allocator.h"
 #include <assert.h>
 #include <string.h>
 
@@ -126,11 +127,12 @@ template<bool Validate> void DecoderLutTable<Validate>::ComputeEntry(const int *
 }
 
 template<bool Validate> const DecoderLutTable<Validate> *DecoderLutTable<Validate>::CreateInstance() {
-    static DecoderLutTable<Validate> *singletonTable = 0;
-    if (!singletonTable) {
-        singletonTable = (DecoderLutTable<Validate> *)_mm_malloc(sizeof(DecoderLutTable<Validate>), CACHE_LINE);
-        singletonTable->ComputeAll();
-    }
+    //note: initialization of local static variable is thread-safe since C++11
+    static const DecoderLutTable<Validate> *singletonTable = []() {
+        DecoderLutTable<Validate> *table = (DecoderLutTable<Validate> *)GetGlobalAllocator().Allocate(sizeof(DecoderLutTable<Validate>), CACHE_LINE);
+        table->ComputeAll();
+        return table;
+    }();
     return singletonTable;
 }
 
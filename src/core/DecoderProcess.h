@@ -98,3 +98,11 @@ struct DecoderCore {
         }
     }
 };
+
+//returns index of LUT entry which DecoderCore (with MaxBytes = 2 or 3) uses for the block at pSource
+//used only for profiling access to LUT, must be kept in sync with the core above
+FORCEINLINE int GetDecoderLutIndex(const char *pSource) {
+    __m128i reg = _mm_loadu_si128((__m128i*)pSource);
+    uint32_t mask = _mm_movemask_epi8(_mm_cmplt_epi8(reg, _mm_set1_epi8(0xC0U)));
+    return int(mask >> 1);
+}
@@ -1,4 +1,5 @@
 #include "core/EncoderLut.h"
+#include "base/Allocator.h"
 #include <assert.h>
 #include <string.h>
 
@@ -72,11 +73,12 @@ template<> void EncoderLutTable<true>::ComputeEntry(int lensMask) {
 }
 
 template<bool ThreeBytes> const EncoderLutTable<ThreeBytes> *EncoderLutTable<ThreeBytes>::CreateInstance() {
-    static EncoderLutTable<ThreeBytes> *singletonTable = 0;
-    if (!singletonTable) {
-        singletonTable = (EncoderLutTable<ThreeBytes> *)_mm_malloc(sizeof(EncoderLutTable<ThreeBytes>), CACHE_LINE);
-        singletonTable->ComputeAll();
-    }
+    //note: initialization of local static variable is thread-safe since C++11
+    static const EncoderLutTable<ThreeBytes> *singletonTable = []() {
+        EncoderLutTable<ThreeBytes> *table = (EncoderLutTable<ThreeBytes> *)GetGlobalAllocator().Allocate(sizeof(EncoderLutTable<ThreeBytes>), CACHE_LINE);
+        table->ComputeAll();
+        return table;
+    }();
     return singletonTable;
 }
 
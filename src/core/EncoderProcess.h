@@ -124,3 +124,35 @@ struct EncoderCore {
         return true;
     }
 };
+
+//computes indices of LUT entries which EncoderCore (with MaxBytes = 2 or 3) uses for the block at pSource
+//returns number of lookups per block (1 for MaxBytes = 2, 2 for MaxBytes = 3)
+//used only for profiling access to LUT, must be kept in sync with the core above
+template<int MaxBytes, int InputType>
+FORCEINLINE int GetEncoderLutIndices(const char *pSource, int indices[2]) {
+    static_assert(MaxBytes == 2 || MaxBytes == 3, "Only MaxBytes = 2 or 3 use LUT");
+    __m128i reg;
+    if (InputType == 2)
+        reg = _mm_loadu_si128((const __m128i *)pSource);
+    else {
+        __m128i reg0 = _mm_loadu_si128((const __m128i *)pSource + 0);
+        __m128i reg1 = _mm_loadu_si128((const __m128i *)pSource + 1);
+        __m128i shuf = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+        reg = _mm_unpacklo_epi64(_mm_shuffle_epi8(reg0, shuf), _mm_shuffle_epi8(reg1, shuf));
+    }
+    __m128i levelB = _mm_srli_epi16(reg, 6);
+    __m128i lenGe2 = _mm_cmpgt_epi16(levelB, _mm_set1_epi16(0x0001U));
+    if (MaxBytes == 2) {
+        __m128i lensAll = _mm_shuffle_epi8(lenGe2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 0, 2, 4, 6, 8, 10, 12, 14, -1, -1));
+        indices[0] = int(uint32_t(_mm_movemask_epi8(lensAll)) / sizeof(EncoderLutEntry));
+        return 1;
+    }
+    else {
+        __m128i lenGe3 = _mm_cmpgt_epi16(levelB, _mm_set1_epi16(0x001FU));
+        __m128i lensMix = _mm_xor_si128(_mm_srli_epi16(lenGe3, 8), lenGe2);
+        uint32_t allMask = _mm_movemask_epi8(lensMix);
+        indices[0] = int(allMask & 255U);
+        indices[1] = int(allMask >> 8U);
+        return 2;
+    }
+}
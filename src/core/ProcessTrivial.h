@@ -22,8 +22,12 @@ FORCEINLINE bool DecodeTrivial(const char *&pSource, const char *pEnd, char *&pD
     uint16_t *ans_d = d;
 
     while (s < (const uint8_t *)pEnd) {
-        if (decode(&state, &codepoint, *s++))
+        if (decode(&state, &codepoint, *s++)) {
+            //reject state is final: no need to look at the rest of input
+            if (state == UTF8_REJECT)
+                break;
             continue;
+        }
         if (OutputType == 2) {
             if (codepoint > 0xFFFFU) {
                 *d++ = (uint16_t)(0xD7C0U + (codepoint >> 10));
@@ -106,3 +110,40 @@ FORCEINLINE bool EncodeTrivial(const char *&pSource, const char *pEnd, char *&pD
 
     return true;
 }
+
+//counts code points in the given range by their length in UTF-8 (histogram indices 0-3 mean 1-4 bytes)
+//UnitSize = 1 for UTF-8 input, 2 for UTF-16 input, 4 for UTF-32 input
+//note: invalid data is counted approximately (continuation bytes and lone low surrogates are skipped)
+template<int UnitSize>
+void CountCodePointLengths(const char *pBegin, const char *pEnd, long long hist[4]) {
+    static_assert(UnitSize == 1 || UnitSize == 2 || UnitSize == 4, "Only 1-byte, 2-byte and 4-byte code units supported");
+    if (UnitSize == 1) {
+        for (const uint8_t *s = (const uint8_t *)pBegin; s < (const uint8_t *)pEnd; s++) {
+            uint8_t byte = *s;
+            if (byte < 0x80U) hist[0]++;
+            else if (byte < 0xC0U) ;
+            else if (byte < 0xE0U) hist[1]++;
+            else if (byte < 0xF0U) hist[2]++;
+            else hist[3]++;
+        }
+    }
+    else if (UnitSize == 2) {
+        for (const uint16_t *s = (const uint16_t *)pBegin; s < (const uint16_t *)pEnd; s++) {
+            uint16_t unit = *s;
+            if (unit < 0x80U) hist[0]++;
+            else if (unit < 0x800U) hist[1]++;
+            else if (unit - 0xD800U < 0x0400U) hist[3]++;
+            else if (unit - 0xDC00U < 0x0400U) ;
+            else hist[2]++;
+        }
+    }
+    else {
+        for (const uint32_t *s = (const uint32_t *)pBegin; s < (const uint32_t *)pEnd; s++) {
+            uint32_t value = *s;
+            if (value < 0x80U) hist[0]++;
+            else if (value < 0x800U) hist[1]++;
+            else if (value < 0x10000U) hist[2]++;
+            else hist[3]++;
+        }
+    }
+}
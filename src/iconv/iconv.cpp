@@ -3,6 +3,7 @@
 #include "buffer/ProcessorPlugins.h"
 #include "buffer/BufferDecoder.h"
 #include "buffer/BufferEncoder.h"
+#include "message/InlineConverter.h"
 #include <assert.h>
 
 size_t iconv(iconv_t cd, const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
@@ -77,6 +78,48 @@ size_t iconv(iconv_t cd, const char **inbuf, size_t *inbytesleft, char **outbuf,
     }
 }
 
+template<int SrcFormat, int DstFormat>
+static size_t ConvertWhole(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    if (!inbuf || !*inbuf) {
+        //no state carried between calls
+        return 0;
+    }
+    else if (!inbytesleft || !outbytesleft) {
+        //error: input / output size not specified
+        errno = EBADF;
+        return (size_t)-1;
+    }
+    else if (!outbuf || !*outbuf) {
+        //extension: return size of output buffer enough for the whole conversion
+        *outbytesleft = ConvertInlineSize<SrcFormat, DstFormat>(*inbytesleft);
+        return 0;
+    }
+
+    ConversionResult res = ConvertInline<SrcFormat, DstFormat>(*inbuf, *inbytesleft, *outbuf, *outbytesleft);
+    *inbuf += res.inputSize;
+    *inbytesleft -= res.inputSize;
+    *outbuf += res.outputSize;
+    *outbytesleft -= res.outputSize;
+
+    if (res.status == csSuccess)
+        return 1;
+    errno = (res.status == csOverflowPossible ? E2BIG : res.status == csIncompleteData ? EINVAL : EILSEQ);
+    return (size_t)-1;
+}
+
+size_t iconv_u8l_utf8_to_utf16(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    return ConvertWhole<dfUtf8, dfUtf16>(inbuf, inbytesleft, outbuf, outbytesleft);
+}
+size_t iconv_u8l_utf8_to_utf32(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    return ConvertWhole<dfUtf8, dfUtf32>(inbuf, inbytesleft, outbuf, outbytesleft);
+}
+size_t iconv_u8l_utf16_to_utf8(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    return ConvertWhole<dfUtf16, dfUtf8>(inbuf, inbytesleft, outbuf, outbytesleft);
+}
+size_t iconv_u8l_utf32_to_utf8(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    return ConvertWhole<dfUtf32, dfUtf8>(inbuf, inbytesleft, outbuf, outbytesleft);
+}
+
 int iconv_close(iconv_t cd) {
     if (cd == (iconv_t)0 || cd == (iconv_t)-1) {
         errno = EBADF;
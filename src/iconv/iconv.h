@@ -67,6 +67,18 @@ extern "C" {
     //
     ICONV_UTF8LUT_EXPORT int iconv_close(iconv_t cd);
 
+    // Interface extension: one-shot conversion of the whole message in fixed direction (no descriptor needed).
+    // Each function behaves like iconv called on a freshly opened descriptor (including extension p.3 above),
+    // but it has no state, allocates no memory and performs no indirect calls, so it is cheap for short messages.
+    // Input is always validated (conversion stops on invalid data with EILSEQ verdict).
+    // Unlike iconv, if output buffer is smaller than the size returned by extension p.3,
+    // then E2BIG verdict is returned immediately, and nothing is converted.
+    //
+    ICONV_UTF8LUT_EXPORT size_t iconv_u8l_utf8_to_utf16(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+    ICONV_UTF8LUT_EXPORT size_t iconv_u8l_utf8_to_utf32(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+    ICONV_UTF8LUT_EXPORT size_t iconv_u8l_utf16_to_utf8(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+    ICONV_UTF8LUT_EXPORT size_t iconv_u8l_utf32_to_utf8(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "buffer/ProcessorSelector.h"
+#include "message/MessageConverter.h"
+
+// Header-only one-shot conversion of a message from one contiguous buffer into another one.
+// It works like ConvertInMemory, but the processor is chosen at compile time by template arguments
+// (they have the same meaning as in ProcessorSelector), and no processor object is created at all.
+// The core kernels are called directly: there is no heap allocation, no plugins, no virtual calls,
+// so the whole conversion can be inlined into a tight loop which converts many small messages, e.g.:
+//   ConversionResult res = ConvertInline<dfUtf8, dfUtf16>(src, srcSize, dst, dstSize);
+// Output buffer must be sufficiently large, see ConvertInlineSize function (see below).
+// Note: error correction is not supported, conversion stops at the first invalid code point.
+// Note: with SpeedMult = 4, decoder still converts in a single stream (only encoder is unrolled).
+template<int SrcFormat, int DstFormat, int Mode = cmValidate, int MaxBytes = 3, int SpeedMult = 1>
+FORCEINLINE ConversionResult ConvertInline(const char *inputBuffer, long long inputSize, char *outputBuffer, long long outputSize);
+
+// Returns the minimal allowed size of the output buffer for ConvertInline routine (in bytes).
+template<int SrcFormat, int DstFormat, int Mode = cmValidate, int MaxBytes = 3, int SpeedMult = 1>
+FORCEINLINE long long ConvertInlineSize(long long inputSize);
+
+
+
+//==============================
+// implementation of some stuff
+//==============================
+
+template<int SrcFormat, int DstFormat, int Mode, int MaxBytes, int SpeedMult>
+FORCEINLINE long long ConvertInlineSize(long long inputSize) {
+    typedef typename ProcessorSelector<SrcFormat, DstFormat>::template WithOptions<Mode, MaxBytes, SpeedMult>::Processor Processor;
+    return Processor::GetOutputMaxSize(inputSize);
+}
+
+template<int SrcFormat, int DstFormat, int Mode, int MaxBytes, int SpeedMult>
+FORCEINLINE ConversionResult ConvertInline(const char *inputBuffer, long long inputSize, char *outputBuffer, long long outputSize) {
+    typedef typename ProcessorSelector<SrcFormat, DstFormat>::template WithOptions<Mode, MaxBytes, SpeedMult>::Processor Processor;
+    ConversionResult result;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    if (inputSize < 0 || (!inputBuffer && inputSize != 0) || outputSize < 0 || (!outputBuffer && outputSize != 0)) {
+        result.status = csInputOutputNoAccess;
+        return result;
+    }
+    if (outputSize < Processor::GetOutputMaxSize(inputSize)) {
+        result.status = csOverflowPossible;
+        return result;
+    }
+
+    if (inputSize == 0) {
+        //note: input pointer may be null here
+        result.status = csSuccess;
+        return result;
+    }
+
+    const char *inputPtr = inputBuffer;
+    char *outputPtr = outputBuffer;
+    bool ok = Processor::ProcessWhole(inputPtr, inputBuffer + inputSize, outputPtr);
+
+    result.inputSize = inputPtr - inputBuffer;
+    result.outputSize = outputPtr - outputBuffer;
+    if (!ok)
+        result.status = csIncorrectData;
+    else if (result.inputSize != inputSize)
+        result.status = csIncompleteData;
+    else
+        result.status = csSuccess;
+    return result;
+}
@@ -1,9 +1,34 @@
 #include "message/MessageConverter.h"
+#include "base/PerfDefs.h"
+#include "base/Timing.h"
+#include "base/Allocator.h"
 #include <stdio.h>
+#include <limits.h>
 
 //=====================================================================================================
 
 ConversionResult ConvertInMemory(BaseBufferProcessor &processor, const char *inputBuffer, long long inputSize, char *outputBuffer, long long outputSize) {
+    ConversionSession session(processor);
+    return session.Convert(inputBuffer, inputSize, outputBuffer, outputSize);
+}
+
+BaseBufferProcessor &ConversionSession::ClearProcessor(BaseBufferProcessor &processor) {
+    //note: called before plugins are constructed
+    processor.Clear();
+    return processor;
+}
+
+ConversionSession::ConversionSession(BaseBufferProcessor &processor) :
+    processor(ClearProcessor(processor)),
+    input(processor, 0, 0),
+    output(processor, 0, 0)
+{}
+
+long long ConversionSession::GetOutputSize(long long inputSize) const {
+    return ContiguousOutput::GetMaxOutputSize(processor, inputSize);
+}
+
+ConversionResult ConversionSession::Convert(const char *inputBuffer, long long inputSize, char *outputBuffer, long long outputSize) {
     ConversionResult result;
     result.status = (ConversionStatus)-1;
     result.inputSize = 0;
@@ -18,15 +43,14 @@ ConversionResult ConvertInMemory(BaseBufferProcessor &processor, const char *inp
         return result;
     }
 
-    long long reqSize = ContiguousOutput::GetMaxOutputSize(processor, inputSize);
+    long long reqSize = GetOutputSize(inputSize);
     if (outputSize < reqSize) {
         result.status = csOverflowPossible;
         return result;
     }
 
-    processor.Clear();
-    ContiguousInput input(processor, inputBuffer, inputSize);
-    ContiguousOutput output(processor, outputBuffer, outputSize);
+    input.Reset(inputBuffer, inputSize);
+    output.Reset(outputBuffer, outputSize);
 
     while (!input.Finished()) {
         //do all the work
@@ -60,10 +84,70 @@ ConversionResult ConvertInMemory(BaseBufferProcessor &processor, const char *inp
 long long ConvertInMemorySize(BaseBufferProcessor &processor, long long inputSize, char **outputBuffer) {
     long long reqSize = ContiguousOutput::GetMaxOutputSize(processor, inputSize);
     if (outputBuffer && *outputBuffer == 0)
-        *outputBuffer = new char[reqSize];
+        *outputBuffer = (char*)processor.GetAllocator().Allocate(size_t(reqSize), CACHE_LINE);
     return reqSize;
 }
 
+void ConvertInMemoryFree(BaseBufferProcessor &processor, long long inputSize, char *outputBuffer) {
+    if (!outputBuffer)
+        return;
+    long long reqSize = ContiguousOutput::GetMaxOutputSize(processor, inputSize);
+    processor.GetAllocator().Deallocate(outputBuffer, size_t(reqSize), CACHE_LINE);
+}
+
+//=====================================================================================================
+
+ConversionResult ConvertBatch(BaseBufferProcessor &processor, int count, const char *inputBuffer, const int *inputOffsets, char *outputBuffer, long long outputSize, int *outputOffsets, unsigned char *statuses) {
+    ConversionResult result;
+    result.status = (ConversionStatus)-1;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    if (count < 0 || !inputOffsets || !outputOffsets || (count > 0 && !statuses)) {
+        result.status = csInputOutputNoAccess;
+        return result;
+    }
+    long long inputSize = inputOffsets[count] - inputOffsets[0];
+    if (inputSize < 0 || (!inputBuffer && inputSize != 0)) {
+        result.status = csInputOutputNoAccess;
+        return result;
+    }
+    if (outputSize < 0 || (!outputBuffer && outputSize != 0)) {
+        result.status = csInputOutputNoAccess;
+        return result;
+    }
+
+    long long reqSize = ConvertBatchSize(processor, inputSize);
+    if (outputSize < reqSize || reqSize > INT_MAX) {
+        result.status = csOverflowPossible;
+        return result;
+    }
+
+    //statistics (if enabled) is collected separately, since ProcessBatch does not modify processor
+    BaseBufferProcessor::Stats stats;
+    int successCount = processor.ProcessBatch(count, inputBuffer, inputOffsets, outputBuffer, int(DMIN(outputSize, (long long)INT_MAX)), outputOffsets, statuses, &stats);
+    if (processor.GetStats())
+        processor.MergeStats(stats);
+
+    result.inputSize = inputSize;
+    result.outputSize = outputOffsets[count];
+    result.status = csSuccess;
+    if (successCount < count) {
+        //find the first failed string
+        for (int i = 0; i < count; i++)
+            if (statuses[i] != csSuccess) {
+                result.status = (ConversionStatus)statuses[i];
+                break;
+            }
+    }
+
+    return result;
+}
+
+long long ConvertBatchSize(BaseBufferProcessor &processor, long long inputSize) {
+    return ContiguousOutput::GetMaxOutputSize(processor, inputSize);
+}
+
 //=====================================================================================================
 
 #if defined(_WIN32)
@@ -135,6 +219,84 @@ end:
     return result;
 }
 
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+ConversionResult ConvertFile_MemoryMappedWhole(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
+#define CHECK_FOR_ERROR(cond) \
+    if (cond) { \
+        result.status = csInputOutputNoAccess; \
+        goto end; \
+    } \
+
+    assert(settings.type == ftMemoryMapWhole);
+    ConversionResult result;
+    result.status = (ConversionStatus)-1;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    int inFile = -1, outFile = -1;
+    void *pInView = MAP_FAILED, *pOutView = MAP_FAILED;
+    struct stat inStat, outStat;
+    long long szIn = 0, szOut = 0;
+
+    CHECK_FOR_ERROR(!inputFilePath || !outputFilePath);
+    inFile = open(inputFilePath, O_RDONLY);
+    CHECK_FOR_ERROR(inFile < 0);
+    CHECK_FOR_ERROR(fstat(inFile, &inStat) != 0);
+    if (!S_ISREG(inStat.st_mode) || (stat(outputFilePath, &outStat) == 0 && !S_ISREG(outStat.st_mode))) {
+        //pipe cannot be mapped (and its size is unknown), device cannot be resized: use ordinary reads and writes
+        close(inFile);
+        settings.type = ftLibC;
+        return ConvertFile(processor, inputFilePath, outputFilePath, settings);
+    }
+    szIn = inStat.st_size;
+    if (szIn > 0) {
+        //note: empty file cannot be mapped
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;  //prefault all pages at once: input is read completely anyway
+#endif
+        pInView = mmap(NULL, size_t(szIn), PROT_READ, flags, inFile, 0);
+        CHECK_FOR_ERROR(pInView == MAP_FAILED);
+        madvise(pInView, size_t(szIn), MADV_SEQUENTIAL);
+    }
+
+    //output file is extended to the worst-case size, then truncated to the real size
+    szOut = ConvertInMemorySize(processor, szIn);
+    outFile = open(outputFilePath, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    CHECK_FOR_ERROR(outFile < 0);
+    CHECK_FOR_ERROR(ftruncate(outFile, off_t(szOut)) != 0);
+    if (szOut > 0) {
+        pOutView = mmap(NULL, size_t(szOut), PROT_READ | PROT_WRITE, MAP_SHARED, outFile, 0);
+        CHECK_FOR_ERROR(pOutView == MAP_FAILED);
+        madvise(pOutView, size_t(szOut), MADV_SEQUENTIAL);
+    }
+
+    result = ConvertInMemory(processor,
+        (pInView == MAP_FAILED ? NULL : (const char*)pInView), szIn,
+        (pOutView == MAP_FAILED ? NULL : (char*)pOutView), szOut
+    );
+end:
+    if (pInView != MAP_FAILED)
+        munmap(pInView, size_t(szIn));
+    if (inFile >= 0)
+        close(inFile);
+    if (pOutView != MAP_FAILED)
+        munmap(pOutView, size_t(szOut));
+    if (outFile >= 0) {
+        if (result.status != csInputOutputNoAccess && ftruncate(outFile, off_t(result.outputSize)) != 0)
+            result.status = csInputOutputNoAccess;
+        close(outFile);
+    }
+#undef CHECK_FOR_ERROR
+
+    return result;
+}
+
 #else
 
 ConversionResult ConvertFile_MemoryMappedWhole(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
@@ -150,9 +312,580 @@ ConversionResult ConvertFile_MemoryMappedWhole(BaseBufferProcessor &processor, c
 
 //=====================================================================================================
 
+#if defined(__unix__) || defined(__APPLE__)
+
+ConversionResult ConvertFile_MemoryMappedWindowed(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
+#define CHECK_FOR_ERROR(cond) \
+    if (cond) { \
+        result.status = csInputOutputNoAccess; \
+        goto end; \
+    } \
+
+    assert(settings.type == ftMemoryMapWindowed);
+    static const long long DefaultWindowSize = 1<<28;   //256 MB
+    ConversionResult result;
+    result.status = (ConversionStatus)-1;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    int inFile = -1, outFile = -1;
+    char *pInView = (char*)MAP_FAILED, *pOutView = (char*)MAP_FAILED;
+    long long inViewSize = 0, outViewSize = 0;
+    struct stat inStat, outStat;
+    long long szIn = 0, inPos = 0, outPos = 0;
+    bool ok = true;
+
+    long long page = sysconf(_SC_PAGESIZE);
+    long long window = (settings.windowSize > 0 ? settings.windowSize : DefaultWindowSize);
+    window = DMAX(ALIGNDOWN(window, page), page);
+    //input step is chosen so that worst-case output of one step fits into window too
+    long long step = window;
+    while (step > page && ContiguousOutput::GetMaxOutputSize(processor, step) > window)
+        step /= 2;
+
+    CHECK_FOR_ERROR(!inputFilePath || !outputFilePath);
+    inFile = open(inputFilePath, O_RDONLY);
+    CHECK_FOR_ERROR(inFile < 0);
+    CHECK_FOR_ERROR(fstat(inFile, &inStat) != 0);
+    if (!S_ISREG(inStat.st_mode) || (stat(outputFilePath, &outStat) == 0 && !S_ISREG(outStat.st_mode))) {
+        //pipe cannot be mapped (and its size is unknown), device cannot be resized: use ordinary reads and writes
+        close(inFile);
+        settings.type = ftLibC;
+        return ConvertFile(processor, inputFilePath, outputFilePath, settings);
+    }
+    szIn = inStat.st_size;
+    outFile = open(outputFilePath, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    CHECK_FOR_ERROR(outFile < 0);
+
+    {
+        processor.Clear();
+        ContiguousInput input(processor, 0, 0);
+        ContiguousOutput output(processor, 0, 0);
+        while (true) {
+            long long len = DMIN(step, szIn - inPos);
+            bool last = (inPos + len == szIn);
+            //views must start at page boundary, while data starts at arbitrary position
+            long long inViewStart = ALIGNDOWN(inPos, page);
+            long long outViewStart = ALIGNDOWN(outPos, page);
+            long long outReq = ContiguousOutput::GetMaxOutputSize(processor, len);
+            inViewSize = inPos + len - inViewStart;
+            outViewSize = outPos + outReq - outViewStart;
+
+            //output file grows by one window at a time
+            CHECK_FOR_ERROR(ftruncate(outFile, off_t(outViewStart + outViewSize)) != 0);
+            if (inViewSize > 0) {
+                int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+                flags |= MAP_POPULATE;
+#endif
+                pInView = (char*)mmap(NULL, size_t(inViewSize), PROT_READ, flags, inFile, off_t(inViewStart));
+                CHECK_FOR_ERROR(pInView == MAP_FAILED);
+                madvise(pInView, size_t(inViewSize), MADV_SEQUENTIAL);
+            }
+            if (outViewSize > 0) {
+                pOutView = (char*)mmap(NULL, size_t(outViewSize), PROT_READ | PROT_WRITE, MAP_SHARED, outFile, off_t(outViewStart));
+                CHECK_FOR_ERROR(pOutView == MAP_FAILED);
+                madvise(pOutView, size_t(outViewSize), MADV_SEQUENTIAL);
+            }
+
+            input.Reset(pInView + (inPos - inViewStart), len, last);
+            output.Reset(pOutView + (outPos - outViewStart), outReq, ConvertInMemorySize(processor, szIn));
+            while (!input.Finished()) {
+                //do all the work
+                ok = processor.Process();
+                //check if hard error occurred
+                if (!ok)
+                    break;
+            }
+            inPos += input.GetProcessedInputSize();
+            outPos += output.GetFilledOutputSize();
+
+            if (pInView != MAP_FAILED) {
+                munmap(pInView, size_t(inViewSize));
+                pInView = (char*)MAP_FAILED;
+#ifdef POSIX_FADV_DONTNEED
+                //consumed input is dropped from page cache, so that memory usage is bounded for huge files
+                //note: the last partial page is kept, since it is mapped again for the next window
+                //(and zero length would mean "up to the end of file")
+                long long consumed = ALIGNDOWN(inPos, page) - inViewStart;
+                if (consumed > 0)
+                    posix_fadvise(inFile, off_t(inViewStart), off_t(consumed), POSIX_FADV_DONTNEED);
+#endif
+            }
+            if (pOutView != MAP_FAILED) {
+                munmap(pOutView, size_t(outViewSize));
+                pOutView = (char*)MAP_FAILED;
+            }
+            //note: processor always converts something from a window unless it is the last one
+            if (!ok || last || input.GetProcessedInputSize() == 0)
+                break;
+        }
+    }
+
+    result.inputSize = inPos;
+    result.outputSize = outPos;
+    if (!ok) {
+        //hard error happened in the loop
+        result.status = csIncorrectData;
+    }
+    else if (inPos != szIn) {
+        //some bytes in the input remain
+        result.status = csIncompleteData;
+    }
+    else {
+        //everything is OK
+        result.status = csSuccess;
+    }
+end:
+    if (pInView != MAP_FAILED)
+        munmap(pInView, size_t(inViewSize));
+    if (inFile >= 0)
+        close(inFile);
+    if (pOutView != MAP_FAILED)
+        munmap(pOutView, size_t(outViewSize));
+    if (outFile >= 0) {
+        if (result.status != csInputOutputNoAccess && ftruncate(outFile, off_t(outPos)) != 0)
+            result.status = csInputOutputNoAccess;
+        close(outFile);
+    }
+#undef CHECK_FOR_ERROR
+
+    return result;
+}
+
+#else
+
+ConversionResult ConvertFile_MemoryMappedWindowed(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
+    ConversionResult result;
+    result.status = csNotImplemented;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    return result;
+}
+
+#endif
+
+//=====================================================================================================
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Minimal io_uring instance created with raw system calls (so that liburing is not required).
+// It is used by one thread only: submission queue tail and completion queue head are owned by us,
+// only the counterparts owned by kernel need acquire/release ordering.
+class AsyncRing {
+    static const int MaxBuffers = 16;
+    int fd;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+    io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe *cqes;
+    unsigned sqEntries;
+    unsigned toSubmit;
+    //if buffers are not registered, then READV / WRITEV requests are used (they are supported by all kernels with io_uring)
+    bool fixed;
+    iovec vecs[MaxBuffers];
+
+    int Enter(unsigned submit, unsigned minComplete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, submit, minComplete, flags, NULL, 0);
+    }
+
+public:
+    AsyncRing() :
+        fd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0),
+        sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0),
+        sqHead(0), sqTail(0), sqMask(0), sqArray(0), cqHead(0), cqTail(0), cqMask(0), cqes(0),
+        sqEntries(0), toSubmit(0), fixed(false)
+    {}
+    ~AsyncRing() {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+    }
+    //creates ring with given number of submission entries, returns false if io_uring is not available
+    bool Init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+        sqEntries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sqRingSize = cqRingSize = DMAX(sqRingSize, cqRingSize);
+        sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+            return false;
+        cqRing = (single ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING));
+        if (cqRing == MAP_FAILED)
+            return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+        char *sq = (char*)sqRing, *cq = (char*)cqRing;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+    //registers buffers for READ_FIXED / WRITE_FIXED operations (pages are pinned once, not on every request)
+    //returns false if registration fails (e.g. if RLIMIT_MEMLOCK is too low): then ordinary requests are used
+    bool RegisterBuffers(const iovec *buffers, int count) {
+        assert(count <= MaxBuffers);
+        fixed = (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers, count) == 0);
+        return fixed;
+    }
+    //queues read (or write) of "size" bytes at "offset" of file, the result is reported with "userData"
+    //the buffer must lie within the buffer with index "bufIndex" passed to RegisterBuffers,
+    //and only one request at a time is allowed for every such buffer
+    void Queue(bool write, int file, char *buffer, unsigned size, long long offset, int bufIndex, unsigned long long userData) {
+        assert(bufIndex >= 0 && bufIndex < MaxBuffers);
+        unsigned tail = *sqTail;
+        assert(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) < sqEntries);
+        unsigned idx = tail & *sqMask;
+        io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = file;
+        if (fixed) {
+            sqe->opcode = (write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED);
+            sqe->buf_index = (unsigned short)bufIndex;
+            sqe->addr = (unsigned long long)(size_t)buffer;
+            sqe->len = size;
+        }
+        else {
+            //note: vector must stay valid until request is completed
+            vecs[bufIndex].iov_base = buffer;
+            vecs[bufIndex].iov_len = size;
+            sqe->opcode = (write ? IORING_OP_WRITEV : IORING_OP_READV);
+            sqe->addr = (unsigned long long)(size_t)&vecs[bufIndex];
+            sqe->len = 1;
+        }
+        sqe->off = (unsigned long long)offset;
+        sqe->user_data = userData;
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        toSubmit++;
+    }
+    //passes all queued requests to kernel without waiting
+    bool Submit() {
+        while (toSubmit > 0) {
+            int res = Enter(toSubmit, 0, 0);
+            if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                return false;
+            if (res > 0)
+                toSubmit -= res;
+        }
+        return true;
+    }
+    //waits until some request is completed, returns its "userData" and result (bytes transferred or -errno)
+    bool Wait(unsigned long long &userData, int &res) {
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe = cqes[head & *cqMask];
+                userData = cqe.user_data;
+                res = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            int cnt = Enter(toSubmit, 1, IORING_ENTER_GETEVENTS);
+            if (cnt < 0 && errno != EINTR)
+                return false;
+            if (cnt > 0)
+                toSubmit -= cnt;
+        }
+    }
+};
+
+ConversionResult ConvertFile_PosixAsync(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
+#define CHECK_FOR_ERROR(cond) \
+    if (cond) { \
+        result.status = csInputOutputNoAccess; \
+        goto end; \
+    } \
+
+    assert(settings.type == ftPosixAsync);
+    static const int Depth = 4;                 //reads in flight ahead of converter (and writes behind it)
+    static const int BlockSize = 1<<20;         //size of one read request
+    static const int CarrySize = 256;           //room for unconverted bytes moved from previous block
+    ConversionResult result;
+    result.status = (ConversionStatus)-1;
+    result.inputSize = 0;
+    result.outputSize = 0;
+
+    //input blocks go into ring of "Depth" buffers: the block k is read into buffer k % Depth,
+    //unconverted tail of the previous block is copied just before it (into carry area)
+    struct InputSlot {
+        long long offset;   //position of block in input file
+        int size;           //size of block
+        int got;            //how many bytes already read
+    } inSlots[Depth];
+    //converted blocks go into ring of "Depth" buffers, each is written while next blocks are converted
+    struct OutputSlot {
+        long long offset;   //position of data in output file
+        int size;           //size of data
+        int put;            //how many bytes already written
+        bool busy;          //write is in progress
+    } outSlots[Depth];
+    char *inBuffers[Depth] = {0}, *outBuffers[Depth] = {0};
+    size_t inBufferSize = 0, outBufferSize = 0;
+    BaseAllocator &allocator = processor.GetAllocator();
+    AsyncRing ring;
+    int inFile = -1, outFile = -1;
+    struct stat inStat;
+    long long szIn = 0, inPos = 0, outPos = 0;
+    int blocksCnt = 0, blocksRead = 0, inflight = 0;
+    bool ok = true, ioError = false;
+    int carry = 0;
+    char carryBuffer[CarrySize];
+
+    //too small buffer cannot even hold an incomplete code point
+    static const int MinBufferSize = 256;
+    int bufferSize = settings.bufferSize;
+    if (bufferSize > 0)
+        bufferSize = DMIN(DMAX(bufferSize, MinBufferSize), BlockSize + CarrySize);
+
+    CHECK_FOR_ERROR(!inputFilePath || !outputFilePath);
+    inFile = open(inputFilePath, O_RDONLY);
+    CHECK_FOR_ERROR(inFile < 0);
+    CHECK_FOR_ERROR(fstat(inFile, &inStat) != 0);
+    if (!S_ISREG(inStat.st_mode) || !ring.Init(2 * Depth)) {
+        //io_uring is not available (or input size is unknown): use ordinary reads and writes
+        close(inFile);
+        settings.type = ftLibC;
+        return ConvertFile(processor, inputFilePath, outputFilePath, settings);
+    }
+    szIn = inStat.st_size;
+    blocksCnt = int((szIn + BlockSize - 1) / BlockSize);
+    outFile = open(outputFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    CHECK_FOR_ERROR(outFile < 0);
+
+    inBufferSize = CarrySize + BlockSize;
+    outBufferSize = size_t(ContiguousOutput::GetMaxOutputSize(processor, inBufferSize));
+    {
+        iovec buffers[2 * Depth];
+        for (int i = 0; i < Depth; i++) {
+            inBuffers[i] = (char*)allocator.Allocate(inBufferSize, 4096);
+            outBuffers[i] = (char*)allocator.Allocate(outBufferSize, 4096);
+            buffers[i].iov_base = inBuffers[i];
+            buffers[i].iov_len = inBufferSize;
+            buffers[Depth + i].iov_base = outBuffers[i];
+            buffers[Depth + i].iov_len = outBufferSize;
+            outSlots[i].busy = false;
+        }
+        //note: if pinning memory is not allowed, requests are still asynchronous (but a bit slower)
+        ring.RegisterBuffers(buffers, 2 * Depth);
+    }
+
+    {
+        processor.Clear();
+        ContiguousInput input(processor, 0, 0, bufferSize);
+        ContiguousOutput output(processor, 0, 0, bufferSize);
+
+        //user data of request: buffer index (as registered) and whether it is write
+        #define QUEUE_READ(i) \
+            ring.Queue(false, inFile, inBuffers[i] + CarrySize + inSlots[i].got, inSlots[i].size - inSlots[i].got, \
+                inSlots[i].offset + inSlots[i].got, (i), (unsigned long long)(i) * 2);
+        #define QUEUE_WRITE(i) \
+            ring.Queue(true, outFile, outBuffers[i] + outSlots[i].put, outSlots[i].size - outSlots[i].put, \
+                outSlots[i].offset + outSlots[i].put, Depth + (i), (unsigned long long)(i) * 2 + 1);
+
+        //start reading first blocks
+        for (; blocksRead < DMIN(Depth, blocksCnt); blocksRead++) {
+            InputSlot &slot = inSlots[blocksRead];
+            slot.offset = (long long)blocksRead * BlockSize;
+            slot.size = int(DMIN((long long)BlockSize, szIn - slot.offset));
+            slot.got = 0;
+            QUEUE_READ(blocksRead);
+            inflight++;
+        }
+        CHECK_FOR_ERROR(!ring.Submit());
+
+        for (int k = 0; k < blocksCnt && ok && !ioError; k++) {
+            int is = k % Depth, os = k % Depth;
+            //wait until the block is read and the output buffer is free
+            while (!ioError && (inSlots[is].got < inSlots[is].size || outSlots[os].busy)) {
+                unsigned long long userData;
+                int res;
+                TIMING_START(IO);
+                CHECK_FOR_ERROR(!ring.Wait(userData, res));
+                TIMING_END(IO, DMAX(res, 0));
+                int i = int(userData / 2);
+                bool write = (userData % 2 != 0);
+                inflight--;
+                if (res <= 0) {
+                    //note: zero means that input file was truncated while we were reading it
+                    ioError = true;
+                }
+                else if (!write) {
+                    inSlots[i].got += res;
+                    if (inSlots[i].got < inSlots[i].size) {
+                        QUEUE_READ(i);
+                        inflight++;
+                    }
+                }
+                else {
+                    outSlots[i].put += res;
+                    if (outSlots[i].put < outSlots[i].size) {
+                        QUEUE_WRITE(i);
+                        inflight++;
+                    }
+                    else
+                        outSlots[i].busy = false;
+                }
+                CHECK_FOR_ERROR(!ring.Submit());
+            }
+            if (ioError)
+                break;
+
+            //convert block with unconverted bytes of the previous one prepended
+            bool last = (k == blocksCnt - 1);
+            char *data = inBuffers[is] + CarrySize - carry;
+            memcpy(data, carryBuffer, carry);
+            input.Reset(data, carry + inSlots[is].size, last);
+            //note: output buffer is small and it is read by kernel right away, so it should stay in cache
+            output.Reset(outBuffers[os], outBufferSize);
+            while (!input.Finished()) {
+                //do all the work
+                ok = processor.Process();
+                //check if hard error occurred
+                if (!ok)
+                    break;
+            }
+            inPos += input.GetProcessedInputSize();
+            carry = int(input.GetRemainingDataSize());
+            //note: with hint = false processor leaves only a few bytes unconverted
+            assert(!ok || last || carry <= CarrySize);
+            if (ok && !last)
+                memcpy(carryBuffer, data + input.GetProcessedInputSize(), carry);
+
+            //write converted data in background
+            OutputSlot &oslot = outSlots[os];
+            oslot.offset = outPos;
+            oslot.size = int(output.GetFilledOutputSize());
+            oslot.put = 0;
+            outPos += oslot.size;
+            if (oslot.size > 0) {
+                oslot.busy = true;
+                QUEUE_WRITE(os);
+                inflight++;
+            }
+            //read the block which goes into the buffer just released
+            if (ok && blocksRead < blocksCnt) {
+                InputSlot &islot = inSlots[is];
+                islot.offset = (long long)blocksRead * BlockSize;
+                islot.size = int(DMIN((long long)BlockSize, szIn - islot.offset));
+                islot.got = 0;
+                QUEUE_READ(is);
+                inflight++;
+                blocksRead++;
+            }
+            CHECK_FOR_ERROR(!ring.Submit());
+        }
+
+        //wait for all writes (and reads, if conversion stopped early)
+        while (inflight > 0) {
+            unsigned long long userData;
+            int res;
+            TIMING_START(IO);
+            CHECK_FOR_ERROR(!ring.Wait(userData, res));
+            TIMING_END(IO, DMAX(res, 0));
+            int i = int(userData / 2);
+            inflight--;
+            if (userData % 2 != 0 && !ioError) {
+                if (res <= 0)
+                    ioError = true;
+                else if ((outSlots[i].put += res) < outSlots[i].size) {
+                    QUEUE_WRITE(i);
+                    inflight++;
+                    CHECK_FOR_ERROR(!ring.Submit());
+                }
+            }
+        }
+        #undef QUEUE_READ
+        #undef QUEUE_WRITE
+    }
+
+    result.inputSize = inPos;
+    result.outputSize = outPos;
+    if (ioError) {
+        //read or write failed
+        result.status = csInputOutputNoAccess;
+    }
+    else if (!ok) {
+        //hard error happened in the loop
+        result.status = csIncorrectData;
+    }
+    else if (inPos != szIn) {
+        //some bytes in the input remain
+        result.status = csIncompleteData;
+    }
+    else {
+        //everything is OK
+        result.status = csSuccess;
+    }
+end:
+    //note: if waiting failed, requests may still be in flight, so buffers are leaked instead of being freed
+    if (inflight == 0) {
+        for (int i = 0; i < Depth; i++) {
+            if (inBuffers[i])
+                allocator.Deallocate(inBuffers[i], inBufferSize, 4096);
+            if (outBuffers[i])
+                allocator.Deallocate(outBuffers[i], outBufferSize, 4096);
+        }
+    }
+    if (inFile >= 0)
+        close(inFile);
+    if (outFile >= 0)
+        close(outFile);
+#undef CHECK_FOR_ERROR
+
+    return result;
+}
+
+#else
+
+ConversionResult ConvertFile_PosixAsync(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
+    //io_uring is only available on Linux: use ordinary reads and writes
+    settings.type = ftLibC;
+    return ConvertFile(processor, inputFilePath, outputFilePath, settings);
+}
+
+#endif
+
+//=====================================================================================================
+
 ConversionResult ConvertFile(BaseBufferProcessor &processor, const char *inputFilePath, const char *outputFilePath, ConvertFilesSettings settings) {
     if (settings.type == ftMemoryMapWhole)
         return ConvertFile_MemoryMappedWhole(processor, inputFilePath, outputFilePath, settings);
+    if (settings.type == ftMemoryMapWindowed)
+        return ConvertFile_MemoryMappedWindowed(processor, inputFilePath, outputFilePath, settings);
+    if (settings.type == ftPosixAsync)
+        return ConvertFile_PosixAsync(processor, inputFilePath, outputFilePath, settings);
 
     ConversionResult result;
     result.status = (ConversionStatus)-1;
@@ -173,9 +906,15 @@ ConversionResult ConvertFile(BaseBufferProcessor &processor, const char *inputFi
         return result;
     }
 
+    //too small buffer cannot even hold an incomplete code point
+    static const int MinBufferSize = 256;
+    int bufferSize = settings.bufferSize;
+    if (bufferSize > 0)
+        bufferSize = DMIN(DMAX(bufferSize, MinBufferSize), processor.GetBufferMaxSize());
+
     processor.Clear();
-    InteractiveInput input(processor);
-    InteractiveOutput output(processor);
+    InteractiveInput input(processor, bufferSize);
+    InteractiveOutput output(processor, bufferSize);
 
     //ask how many output buffers are there
     int streamsCnt = output.GetStreamsCount();
@@ -186,9 +925,14 @@ ConversionResult ConvertFile(BaseBufferProcessor &processor, const char *inputFi
         int maxSize;
         input.GetBuffer(inputBuffer, maxSize);
         //read bytes from input
+        TIMING_START(IO);
         int readSize = (int)fread(inputBuffer, 1, maxSize, fin);
+        TIMING_END(IO, readSize);
         //tell how many bytes we really have
         input.ConfirmInputBytes(readSize, !!feof(fin));
+        //nothing to convert: file is empty, or its size is a multiple of buffer size
+        if (input.GetRemainingDataSize() == 0)
+            continue;
 
         //do all the work
         bool ok = processor.Process();
@@ -200,7 +944,9 @@ ConversionResult ConvertFile(BaseBufferProcessor &processor, const char *inputFi
             int outSize;
             output.GetBuffer(outputBuffer, outSize, k);
             //write them to file
+            TIMING_START(IO);
             fwrite(outputBuffer, 1, outSize, fout);
+            TIMING_END(IO, outSize);
         }
 
         //check if hard error occurred
@@ -56,10 +56,61 @@ ConversionResult ConvertInMemory(BaseBufferProcessor &processor, const char *inp
 // Returns the minimal allowed size of the output buffer (in bytes).
 // It is surely enough to contain conversion output for any possible input buffer of specified size.
 // Additionally, if outputBuffer points to char* with null value, then:
-//    1. a buffer of that size will be allocated (with new char[]);
+//    1. a buffer of that size will be allocated (with allocator of the processor, see BaseBufferProcessor::GetAllocator);
 //    2. pointer to this new buffer will be saved into *outputBuffer;
+// The allocated buffer must be freed by ConvertInMemoryFree function (see below).
 long long ConvertInMemorySize(BaseBufferProcessor &processor, long long inputSize, char **outputBuffer = 0);
 
+// Frees the output buffer allocated by ConvertInMemorySize (with the same arguments as were passed to it).
+void ConvertInMemoryFree(BaseBufferProcessor &processor, long long inputSize, char *outputBuffer);
+
+// Reusable session for in-memory conversion of many messages one after another.
+// ConvertInMemory function clears the processor, creates plugins and allocates their internal buffers on every call.
+// A session does all of this only once (in constructor), then each 'Convert' call only re-points the plugins.
+// Every call of 'Convert' method works exactly the same way as ConvertInMemory function.
+// The processor is exclusively bound to the session during its lifetime: do not use it in any other way meanwhile.
+class ConversionSession {
+public:
+    explicit ConversionSession(BaseBufferProcessor &processor);
+    // Converts data from one contiguous buffer in memory into another one (see ConvertInMemory).
+    ConversionResult Convert(const char *inputBuffer, long long inputSize, char *outputBuffer, long long outputSize);
+    // Returns the minimal allowed size of the output buffer (see ConvertInMemorySize).
+    long long GetOutputSize(long long inputSize) const;
+    // Returns the processor bound to the session.
+    BaseBufferProcessor &GetProcessor() const { return processor; }
+
+private:
+    ConversionSession(const ConversionSession &);               //not copyable
+    ConversionSession &operator= (const ConversionSession &);   //not copyable
+    static BaseBufferProcessor &ClearProcessor(BaseBufferProcessor &processor);
+
+    BaseBufferProcessor &processor;
+    ContiguousInput input;
+    ContiguousOutput output;
+};
+
+
+//======================================= Batch conversion ========================================
+
+// Convert a batch of many independent strings (e.g. a column of a table) in one call.
+// The strings are stored contiguously in the input buffer (like in Apache Arrow):
+//   i-th string occupies bytes [inputOffsets[i] .. inputOffsets[i+1]) of inputBuffer, for i = 0, 1, ..., count-1.
+// The converted strings are stored contiguously into outputBuffer,
+// and their offsets are written into outputOffsets array (it must have count+1 elements, the first one is zero).
+// Every string is converted as a separate message, i.e. an invalid string does not stop conversion of other ones.
+// The status of i-th string is saved into statuses[i] (a value from ConversionStatus enum):
+//   csSuccess, csIncompleteData, or csIncorrectData (only valid prefix of the string is converted in the two last cases).
+// The returned result has status csSuccess if all the strings are converted successfully,
+// otherwise it has status of the first failed string (or any other error status for the whole batch).
+// The returned sizes are the total sizes of input data and output data.
+// Output buffer must be sufficiently large, see ConvertBatchSize function (see below).
+// Note: all the offsets must fit into int type.
+ConversionResult ConvertBatch(BaseBufferProcessor &processor, int count, const char *inputBuffer, const int *inputOffsets, char *outputBuffer, long long outputSize, int *outputOffsets, unsigned char *statuses);
+
+// Request information about the required size of the output buffer in ConvertBatch routine.
+// Returns the minimal allowed size of the output buffer (in bytes), given the total size of all input strings.
+long long ConvertBatchSize(BaseBufferProcessor &processor, long long inputSize);
+
 
 //===================================== File-to-file conversion ===================================
 
@@ -70,12 +121,31 @@ enum FileIOType {
 
     ftMemoryMapWhole = 1,
     // Map whole file into virtual address space.
-    // Uses OS-specific API.
+    // Uses OS-specific API: WinAPI file mapping on Windows, mmap on Linux and other POSIX systems.
+    // Output file is extended to the worst-case size during conversion (see ConvertInMemorySize),
+    // then truncated to the real size of output.
+    // On POSIX systems, if input or output is not a regular file (e.g. pipe or /dev/null), then it works exactly as ftLibC.
+
+    ftMemoryMapWindowed = 2,
+    // Map a sliding window of input file and a sliding window of output file into virtual address space.
+    // Unlike ftMemoryMapWhole, address space and memory usage are bounded by window size (see windowSize),
+    // so it works for files larger than RAM: output file is extended window-by-window.
+    // Windows end where processor stops (never in the middle of a code point), the next window starts there.
+    // Uses mmap, only implemented on POSIX systems.
+    // If input or output is not a regular file (e.g. pipe or /dev/null), then it works exactly as ftLibC.
+
+    ftPosixAsync = 3,
+    // Read and write files asynchronously with io_uring, so that conversion overlaps with storage I/O.
+    // Input is read in blocks (1 MB each): a few reads are in flight ahead of conversion,
+    // and a few writes of converted blocks are in flight behind it.
+    // Buffers are registered in kernel once if possible; if registration fails (e.g. due to RLIMIT_MEMLOCK),
+    // then ordinary vectored reads and writes are used instead.
+    // Only implemented on Linux: if io_uring is not available (old kernel, disabled by sysctl or seccomp),
+    // or if input is not a regular file, then it works exactly as ftLibC.
 
     //TODO: perhaps implement some other types?
     //ftPosix,
     //ftWinApi,
-    //ftPosixAsync,
     //ftWinApiAsync,
     //...
 };
@@ -84,10 +154,16 @@ struct ConvertFilesSettings {
     //which functions to use for IO
     FileIOType type;
 
-    //TODO: should we allow to set buffer size?
-    //int bufferSize;
+    //size of input buffer (in bytes) used for chunk-by-chunk conversion
+    //zero means processor's recommended size (see BaseBufferProcessor::GetInputBufferRecommendedSize)
+    //note: ignored when file is memory-mapped, with ftPosixAsync it is only the size of chunks passed to processor
+    int bufferSize;
+
+    //size of input and output windows (in bytes) mapped at once when type is ftMemoryMapWindowed
+    //zero means default size (256 MB), it is rounded down to multiple of page size
+    long long windowSize;
 
-    ConvertFilesSettings() : type(ftLibC)/*, bufferSize(0)*/ {}
+    ConvertFilesSettings() : type(ftLibC), bufferSize(0), windowSize(0) {}
 };
 
 // Convert data from one file to another file.
@@ -0,0 +1,1946 @@
+// Self-contained benchmark suite: needs no external programs and no input files.
+// Measures conversion speed on generated inputs of various sizes and character distributions
+// (uniformly random code points and realistic texts from CorpusGenerator):
+//   core:       every DecoderCore / EncoderCore configuration called directly in a loop
+//   processor:  every BufferDecoder / BufferEncoder instantiation (see GenerateProcessor in AllProcessors.cpp)
+//   message:    message-level APIs: ConvertInMemory, ConversionSession, ConvertBatch, ConvertInline
+//   sweep:      every direction on input sizes from 256 bytes up to gigabytes (not included in "all")
+//   thrash:     cost of a call with warm caches versus a call after caches are thrashed (not included in "all")
+//   latency:    percentiles of time spent in one call on small messages, also via iconv (not included in "all")
+//   scaling:    aggregate speed of many threads converting in parallel, from one thread to all CPUs (not included in "all")
+//   compare:    processors versus iconv interface, system iconv and scalar DFA, with outputs checked (not included in "all")
+//   files:      every processor on inputs loaded from files, e.g. slowest inputs found by PerfFuzzer (not included in "all")
+//   roofline:   speed of conversion (with ordinary and streaming stores) compared to speed of memcpy with the same memory traffic (not included in "all")
+//   fileio:     file-to-file conversion (ConvertFile) with every type of IO, on temporary files (not included in "all")
+// Every benchmark is run a few times for warmup, then measured several times (repetitions).
+// The median and dispersion over repetitions are reported, optionally saved as JSON.
+// Results can be compared against JSON saved earlier (baseline), then pass/fail verdict is printed for every benchmark.
+// Note: cycles are measured with rdtsc, i.e. they are reference cycles of constant frequency.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer/ProcessorSelector.h"
+#include "message/MessageConverter.h"
+#include "message/InlineConverter.h"
+#include "core/ProcessTrivial.h"
+#include "base/CacheInfo.h"
+#include "tests/CorpusGenerator.h"
+#include "iconv/iconv.h"
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+    #include <cpuid.h>
+#endif
+//memcpy with ordinary stores: CustomMemcpy_t_t
+//note: non-temporal loads need SSE 4.1, so they are not used
+#include "base/CustomMemcpy.h"
+//memcpy with non-temporal stores (the same as used for streaming output)
+#include "base/StreamingMemcpy.h"
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+    #include <dlfcn.h>
+#endif
+
+BaseBufferProcessor *GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter = 0, bool withStats = false);
+
+enum SuiteType {
+    stCore = 1,
+    stProcessor = 2,
+    stMessage = 4,
+    stAll = 7,
+    stSweep = 8,
+    stThrash = 16,
+    stLatency = 32,
+    stScaling = 64,
+    stCompare = 128,
+    stFiles = 256,
+    stRoofline = 512,
+    stFileIO = 1024,
+};
+
+struct Config {
+    int suites;                     // --suite=%s (comma-separated list)
+    int warmupRuns;                 // --warmup=%d
+    int repetitions;                // -r=%d
+    long long minBytesPerSample;    // --minbytes=%d
+    std::vector<long long> sizes;   // --sizes=%s (comma-separated list)
+    bool sizesGiven;                //was --sizes specified explicitly?
+    const char *filter;             // --filter=%s
+    const char *jsonPath;           // --json=%s
+    const char *distributions;      // --dists=%s (comma-separated list)
+    long long sweepMaxSize;         // --sweepmax=%lld
+    long long thrashSize;           // --thrashsize=%lld
+    int latencySamples;             // --samples=%d
+    std::vector<long long> threads; // --threads=%s (comma-separated list)
+    long long threadSize;           // --threadsize=%lld
+    const char *files;              // --files=%s (comma-separated list)
+    const char *baselinePath;       // --baseline=%s
+    double threshold;               // --threshold=%lf (percents)
+
+    Config() {
+        suites = stAll;
+        warmupRuns = 1;
+        repetitions = 7;
+        minBytesPerSample = 1<<19;
+        sizes = {64, 1<<10, 1<<16, 1<<20};
+        sizesGiven = false;
+        filter = 0;
+        jsonPath = 0;
+        distributions = 0;
+        sweepMaxSize = 1LL<<30;
+        thrashSize = 0;
+        latencySamples = 10000;
+        threadSize = 8<<20;
+        files = 0;
+        baselinePath = 0;
+        threshold = 5.0;
+    }
+};
+static Config cfg;
+
+void PrintHelp() {
+    printf(
+        "Usage:\n"
+        "  Benchmarks [options]\n"
+        "Options:\n"
+        "  --suite=%%s      comma-separated list of suites to run:\n"
+        "                  core, processor, message, sweep, thrash, latency, scaling, compare, files, roofline, fileio\n"
+        "                  (default: all = core,processor,message)\n"
+        "  --filter=%%s     run only benchmarks with full name containing given substring\n"
+        "  --sizes=%%s      comma-separated list of input sizes in bytes (default: 64,1024,65536,1048576)\n"
+        "                  (for latency: 16,32,64,...,4096, for roofline: 65536,1048576,16777216,67108864,\n"
+        "                  for fileio: 1048576,67108864)\n"
+        "  --dists=%%s      comma-separated list of input distributions\n"
+        "                  (default: all, for sweep and roofline: len123,russian, for thrash, latency, scaling and fileio: russian)\n"
+        "  --sweepmax=%%lld max input size in sweep suite, it starts from 256 bytes (default: 1073741824)\n"
+        "  --thrashsize=%%lld size of memory written between calls in thrash suite (default: 1.5 x (L2 + L3))\n"
+        "  --samples=%%d    number of timed calls per benchmark in latency suite (default: 10000)\n"
+        "  --threads=%%s    comma-separated list of thread counts in scaling suite (default: 1,2,4,...,all CPUs)\n"
+        "  --threadsize=%%lld size of input converted by every thread in scaling suite (default: 8388608)\n"
+        "  --files=%%s      comma-separated list of input files for files suite\n"
+        "                  every file name must contain direction of conversion, e.g. slow_utf8-utf16_0.bin\n"
+        "  -r=%%d           number of measured repetitions (default: 7)\n"
+        "  --warmup=%%d     number of warmup runs before measurement (default: 1)\n"
+        "  --minbytes=%%d   minimal amount of input data converted in one repetition (default: 524288)\n"
+        "  --json=%%s       save results in JSON format to given file\n"
+        "  --baseline=%%s   compare results with JSON file saved earlier, fail if some benchmark is slower\n"
+        "  --threshold=%%lf allowed slowdown in percents when comparing with baseline (default: 5)\n"
+        "Full name of a benchmark looks like: suite/name/distribution/size\n"
+    );
+    exit(1);
+}
+
+const char *GetFormatName(int format) {
+    return format == dfUtf8 ? "utf8" : format == dfUtf16 ? "utf16" : "utf32";
+}
+const char *GetModeName(int mode) {
+    return mode == cmFast ? "fast" : mode == cmFull ? "full" : "validate";
+}
+static const int Directions[4][2] = {{dfUtf8, dfUtf16}, {dfUtf8, dfUtf32}, {dfUtf16, dfUtf8}, {dfUtf32, dfUtf8}};
+
+//=========================================== Input data ==========================================
+
+// Distribution of characters in generated input.
+// Uniform distributions: every code point has UTF-8 length chosen uniformly among the allowed ones,
+// then the code point is chosen uniformly among the code points of this length (surrogates excluded).
+// Realistic distributions: text is generated by CorpusGenerator with given profile.
+struct Distribution {
+    const char *name;
+    bool allowedLens[4];
+    int profile;        //from CorpusProfile enum, or -1 for uniform distribution
+
+    bool IsUniform() const {
+        return profile < 0;
+    }
+    int GetMaxLen() const {
+        if (!IsUniform())
+            return GetCorpusMaxLength(profile);
+        int res = 0;
+        for (int i = 0; i < 4; i++)
+            if (allowedLens[i])
+                res = i + 1;
+        return res;
+    }
+};
+static const Distribution Distributions[] = {
+    {"ascii",   {true, false, false, false}, -1},
+    {"len12",   {true, true, false, false}, -1},
+    {"len123",  {true, true, true, false}, -1},
+    {"len1234", {true, true, true, true}, -1},
+    {"english", {}, cpEnglish},
+    {"russian", {}, cpRussian},
+    {"chinese", {}, cpChinese},
+    {"emoji",   {}, cpEmoji},
+    {"json",    {}, cpJson},
+    {"html",    {}, cpHtml},
+};
+static const int DistributionsCount = sizeof(Distributions) / sizeof(Distributions[0]);
+
+//checks if distribution is in the comma-separated list of --dists option (or in the given default list)
+bool IsDistributionSelected(const Distribution &dist, const char *defaultList = 0) {
+    const char *list = (cfg.distributions ? cfg.distributions : defaultList);
+    if (!list)
+        return true;
+    std::string padded = std::string(",") + list + ",";
+    return padded.find(std::string(",") + dist.name + ",") != std::string::npos;
+}
+
+//generates text of at most 'size' bytes consisting of whole code points
+//if 'boundaries' is not null, then offsets of all code points are saved there
+std::vector<char> GenerateInput(int format, long long size, const Distribution &dist, unsigned seed, std::vector<int> *boundaries = 0) {
+    std::vector<char> res;
+    if (!dist.IsUniform()) {
+        GenerateCorpus(res, CorpusSettings(dist.profile), format, size, size, seed, boundaries);
+        return res;
+    }
+    static const int MaxCode[5] = {-1, 0x7F, 0x7FF, 0xFFFF, 0x10FFFF};
+    std::mt19937 rnd(seed);
+    res.resize(size + 4);
+    long long pos = 0;
+    while (true) {
+        int len;
+        do { len = rnd() % 4; } while (!dist.allowedLens[len]);
+        int code;
+        do {
+            code = MaxCode[len] + 1 + rnd() % (MaxCode[len + 1] - MaxCode[len]);
+        } while (code >= 0xD800 && code < 0xE000);
+        char buff[4];
+        int bytes = WriteCodePoint(code, format, buff);
+        if (pos + bytes > size)
+            break;
+        if (boundaries)
+            boundaries->push_back(int(pos));
+        memcpy(&res[pos], buff, bytes);
+        pos += bytes;
+    }
+    res.resize(pos);
+    return res;
+}
+
+//=========================================== Measurement =========================================
+
+struct Summary {
+    double median;
+    double mad;     //median absolute deviation
+    double min, max;
+};
+Summary Summarize(std::vector<double> samples) {
+    Summary res;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    res.median = (n % 2 ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) * 0.5);
+    res.min = samples.front();
+    res.max = samples.back();
+    std::vector<double> deviations;
+    for (size_t i = 0; i < n; i++)
+        deviations.push_back(samples[i] > res.median ? samples[i] - res.median : res.median - samples[i]);
+    std::sort(deviations.begin(), deviations.end());
+    res.mad = (n % 2 ? deviations[n/2] : (deviations[n/2 - 1] + deviations[n/2]) * 0.5);
+    return res;
+}
+
+struct BenchResult {
+    std::string suite, name, distribution;
+    long long size;         //size of input (bytes) converted in one call
+    long long calls;        //number of calls in one repetition
+    Summary cyclesPerByte;
+    Summary gigabytesPerSec;
+    std::string note;       //additional info (e.g. which cache can hold the data)
+    std::vector<double> cyclesSamples;  //cycles per byte in every repetition
+    std::vector<double> percentiles;    //cycles per call at LatencyQuantiles (latency suite only)
+};
+static std::vector<BenchResult> allResults;
+
+std::string GetFullName(const char *suite, const std::string &name, const char *distribution, long long size) {
+    char buff[32];
+    sprintf(buff, "%lld", size);
+    return std::string(suite) + "/" + name + "/" + distribution + "/" + buff;
+}
+bool IsSelected(const char *suite, const std::string &name, const char *distribution, long long size) {
+    return !cfg.filter || strstr(GetFullName(suite, name, distribution, size).c_str(), cfg.filter);
+}
+
+//saves and prints result of a benchmark, given samples measured on repetitions
+void AddResult(const char *suite, const std::string &name, const char *distribution, long long bytes, long long calls,
+    const std::vector<double> &cycles, const std::vector<double> &speeds, const std::string &note = ""
+) {
+    BenchResult res;
+    res.suite = suite;
+    res.name = name;
+    res.distribution = distribution;
+    res.size = bytes;
+    res.calls = calls;
+    res.cyclesPerByte = Summarize(cycles);
+    res.cyclesSamples = cycles;
+    res.gigabytesPerSec = Summarize(speeds);
+    res.note = note;
+    allResults.push_back(res);
+    printf("%-42s %-8s %10lld :  %7.3f cyc/B (+-%5.1f%%)  %7.3f GB/s  %s\n",
+        (res.suite + "/" + res.name).c_str(), distribution, bytes,
+        res.cyclesPerByte.median, 100.0 * res.cyclesPerByte.mad / DMAX(res.cyclesPerByte.median, 1e-9),
+        res.gigabytesPerSec.median, note.c_str()
+    );
+    fflush(stdout);
+}
+
+//measures given function, which converts 'bytes' bytes of input on every call
+void Measure(const char *suite, const std::string &name, const char *distribution, long long bytes, const std::function<void()> &func, const std::string &note = "") {
+    if (bytes <= 0)
+        return;
+    long long calls = DMAX(cfg.minBytesPerSample / bytes, 1);
+    for (int w = 0; w < cfg.warmupRuns; w++)
+        for (long long c = 0; c < calls; c++)
+            func();
+
+    std::vector<double> cycles, speeds;
+    for (int r = 0; r < cfg.repetitions; r++) {
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t startTicks = __rdtsc();
+        for (long long c = 0; c < calls; c++)
+            func();
+        uint64_t endTicks = __rdtsc();
+        auto endTime = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(endTime - startTime).count();
+        cycles.push_back(double(endTicks - startTicks) / (calls * bytes));
+        speeds.push_back(calls * bytes / DMAX(seconds, 1e-9) * 1e-9);
+    }
+    AddResult(suite, name, distribution, bytes, calls, cycles, speeds, note);
+}
+
+//prevents compiler from throwing away the measured code
+static volatile long long sink = 0;
+
+//=========================================== Core suite ==========================================
+
+template<int MaxBytes, bool CheckExceed, bool Validate, int OutputType>
+void BenchDecoderCore(int mode) {
+    char name[64];
+    sprintf(name, "decoder/utf8-%s/b%d/%s", GetFormatName(OutputType == 2 ? dfUtf16 : dfUtf32), MaxBytes, GetModeName(mode));
+    const DecoderLutEntry<Validate> *lutTable = DecoderLutTable<Validate>::GetArray();
+    for (int d = 0; d < DistributionsCount; d++) {
+        const Distribution &dist = Distributions[d];
+        if (!dist.IsUniform() || dist.GetMaxLen() != MaxBytes || !IsDistributionSelected(dist))
+            continue;   //core processes only code points of at most MaxBytes bytes
+        for (long long size : cfg.sizes) {
+            if (!IsSelected("core", name, dist.name, size))
+                continue;
+            std::vector<char> input = GenerateInput(dfUtf8, size, dist, 13);
+            std::vector<char> output(input.size() * OutputType + 64);
+            const char *inputEnd = input.data() + input.size();
+            //core reads 16 bytes at once, so it stops near the end of input
+            long long processed = 0;
+            auto func = [&]() {
+                const char *src = input.data();
+                char *dst = output.data();
+                while (src + 16 <= inputEnd && DecoderCore<MaxBytes, CheckExceed, Validate, OutputType>()(src, dst, lutTable));
+                processed = src - input.data();
+                sink = sink + (dst - output.data());
+            };
+            func();
+            Measure("core", name, dist.name, processed, func);
+        }
+    }
+}
+
+template<int MaxBytes, bool CheckExceed, int InputType>
+void BenchEncoderCore(int mode) {
+    char name[64];
+    sprintf(name, "encoder/%s-utf8/b%d/%s", GetFormatName(InputType == 2 ? dfUtf16 : dfUtf32), MaxBytes, GetModeName(mode));
+    const EncoderLutEntry *lutTable = EncoderLutTable<MaxBytes == 3>::GetArray();
+    for (int d = 0; d < DistributionsCount; d++) {
+        const Distribution &dist = Distributions[d];
+        if (!dist.IsUniform() || dist.GetMaxLen() != MaxBytes || !IsDistributionSelected(dist))
+            continue;
+        for (long long size : cfg.sizes) {
+            if (!IsSelected("core", name, dist.name, size))
+                continue;
+            std::vector<char> input = GenerateInput(InputType == 2 ? dfUtf16 : dfUtf32, size, dist, 13);
+            std::vector<char> output(input.size() / InputType * 3 + 64);
+            const char *inputEnd = input.data() + input.size();
+            //core reads 8 code units at once
+            long long processed = 0;
+            auto func = [&]() {
+                const char *src = input.data();
+                char *dst = output.data();
+                while (src + 8 * InputType <= inputEnd && EncoderCore<MaxBytes, CheckExceed, InputType>()(src, dst, lutTable));
+                processed = src - input.data();
+                sink = sink + (dst - output.data());
+            };
+            func();
+            Measure("core", name, dist.name, processed, func);
+        }
+    }
+}
+
+void RunCoreSuite() {
+    #define BENCH_DEC(maxB, type) \
+        BenchDecoderCore<maxB, false, false, type>(cmFast); \
+        BenchDecoderCore<maxB, true, false, type>(cmFull); \
+        BenchDecoderCore<maxB, true, true, type>(cmValidate);
+    #define BENCH_ENC(maxB, type) \
+        BenchEncoderCore<maxB, false, type>(cmFast); \
+        BenchEncoderCore<maxB, true, type>(cmFull);
+    //note: encoder core has no separate validation (it is the same as exceed check)
+    BENCH_DEC(1, 2); BENCH_DEC(1, 4); BENCH_ENC(1, 2); BENCH_ENC(1, 4);
+    BENCH_DEC(2, 2); BENCH_DEC(2, 4); BENCH_ENC(2, 2); BENCH_ENC(2, 4);
+    BENCH_DEC(3, 2); BENCH_DEC(3, 4); BENCH_ENC(3, 2); BENCH_ENC(3, 4);
+}
+
+//========================================= Processor suite =======================================
+
+void BenchProcessor(int srcFormat, int dstFormat, int maxBytes, int mode, int mult) {
+    char name[64];
+    sprintf(name, "%s-%s/b%d/%s/x%d", GetFormatName(srcFormat), GetFormatName(dstFormat), maxBytes, GetModeName(mode), mult);
+    std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(srcFormat, dstFormat, maxBytes, mode, mult));
+    if (!processor)
+        return;
+    for (int d = 0; d < DistributionsCount; d++) {
+        const Distribution &dist = Distributions[d];
+        if (mode == cmFast && dist.GetMaxLen() > maxBytes)
+            continue;   //fast-only processor does not support these code points
+        if (!IsDistributionSelected(dist))
+            continue;
+        for (long long size : cfg.sizes) {
+            if (!IsSelected("processor", name, dist.name, size))
+                continue;
+            std::vector<char> input = GenerateInput(srcFormat, size, dist, 13);
+            ConversionSession session(*processor);
+            std::vector<char> output(session.GetOutputSize(input.size()));
+            ConversionResult res = session.Convert(input.data(), input.size(), output.data(), output.size());
+            if (res.status != csSuccess) {
+                printf("%s: conversion failed with status %d\n", GetFullName("processor", name, dist.name, size).c_str(), res.status);
+                continue;
+            }
+            Measure("processor", name, dist.name, input.size(), [&]() {
+                ConversionResult r = session.Convert(input.data(), input.size(), output.data(), output.size());
+                sink = sink + r.outputSize;
+            });
+        }
+    }
+}
+
+void RunProcessorSuite() {
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        BenchProcessor(from, to, 0, cmValidate, 1);
+        for (int maxB = 1; maxB <= 3; maxB++)
+            for (int mode = cmFast; mode <= cmValidate; mode++)
+                for (int mult = 1; mult <= 4; mult += 3)
+                    BenchProcessor(from, to, maxB, mode, mult);
+    }
+}
+
+//========================================== Message suite ========================================
+
+template<int SrcFormat, int DstFormat>
+void BenchMessageApis() {
+    typedef typename ProcessorSelector<SrcFormat, DstFormat>::template WithOptions<>::Processor Processor;
+    std::unique_ptr<BaseBufferProcessor> processor(new Processor());
+    char prefix[64];
+    sprintf(prefix, "%s-%s/", GetFormatName(SrcFormat), GetFormatName(DstFormat));
+
+    for (int d = 0; d < DistributionsCount; d++) {
+        const Distribution &dist = Distributions[d];
+        if (!IsDistributionSelected(dist))
+            continue;
+        for (long long size : cfg.sizes) {
+            std::vector<int> boundaries;
+            std::vector<char> input = GenerateInput(SrcFormat, size, dist, 13, &boundaries);
+            long long inputSize = input.size();
+            std::vector<char> output(DMAX(ConvertInMemorySize(*processor, inputSize), ConvertBatchSize(*processor, inputSize)));
+
+            std::string name = std::string(prefix) + "ConvertInMemory";
+            if (IsSelected("message", name, dist.name, size))
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    ConversionResult r = ConvertInMemory(*processor, input.data(), inputSize, output.data(), output.size());
+                    sink = sink + r.outputSize;
+                });
+
+            name = std::string(prefix) + "ConversionSession";
+            if (IsSelected("message", name, dist.name, size)) {
+                ConversionSession session(*processor);
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    ConversionResult r = session.Convert(input.data(), inputSize, output.data(), output.size());
+                    sink = sink + r.outputSize;
+                });
+            }
+
+            //checksum of output: computed by plugin after every chunk vs separate pass over whole output
+            name = std::string(prefix) + "ConversionSession/crc32c-fused";
+            if (IsSelected("message", name, dist.name, size)) {
+                ConversionSession session(*processor);
+                OutputChecksum checksum(*processor);
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    checksum.Reset();
+                    session.Convert(input.data(), inputSize, output.data(), output.size());
+                    sink = sink + checksum.GetChecksum();
+                });
+            }
+            name = std::string(prefix) + "ConversionSession/crc32c-separate";
+            if (IsSelected("message", name, dist.name, size)) {
+                ConversionSession session(*processor);
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    ConversionResult r = session.Convert(input.data(), inputSize, output.data(), output.size());
+                    sink = sink + Crc32c(0, output.data(), r.outputSize);
+                });
+            }
+
+            name = std::string(prefix) + "ConvertInline";
+            if (IsSelected("message", name, dist.name, size))
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    ConversionResult r = ConvertInline<SrcFormat, DstFormat>(input.data(), inputSize, output.data(), output.size());
+                    sink = sink + r.outputSize;
+                });
+
+            //batch of strings of ~32 bytes each (split at code point boundaries)
+            name = std::string(prefix) + "ConvertBatch";
+            if (IsSelected("message", name, dist.name, size) && boundaries.size() > 0) {
+                std::vector<int> inputOffsets;
+                for (size_t i = 0; i < boundaries.size(); i++)
+                    if (inputOffsets.empty() || boundaries[i] >= inputOffsets.back() + 32)
+                        inputOffsets.push_back(boundaries[i]);
+                inputOffsets.push_back(int(inputSize));
+                int count = int(inputOffsets.size()) - 1;
+                std::vector<int> outputOffsets(count + 1);
+                std::vector<unsigned char> statuses(count);
+                Measure("message", name, dist.name, inputSize, [&]() {
+                    ConversionResult r = ConvertBatch(*processor, count, input.data(), inputOffsets.data(), output.data(), output.size(), outputOffsets.data(), statuses.data());
+                    sink = sink + r.outputSize;
+                });
+            }
+        }
+    }
+}
+
+void RunMessageSuite() {
+    BenchMessageApis<dfUtf8, dfUtf16>();
+    BenchMessageApis<dfUtf8, dfUtf32>();
+    BenchMessageApis<dfUtf16, dfUtf8>();
+    BenchMessageApis<dfUtf32, dfUtf8>();
+}
+
+//=========================================== Sweep suite =========================================
+
+//returns largest size not exceeding 'size' which does not cut any code point in the middle
+long long AlignToCodePoint(const char *data, long long size, int format) {
+    if (format == dfUtf32)
+        return ALIGNDOWN(size, 4);
+    if (format == dfUtf16) {
+        size = ALIGNDOWN(size, 2);
+        //do not separate high surrogate from low surrogate
+        if (size >= 2 && (((const unsigned char *)data)[size - 1] & 0xFC) == 0xD8)
+            size -= 2;
+        return size;
+    }
+    //move back over continuation bytes, then check if the last code point is complete
+    long long start = size;
+    while (start > 0 && (data[start - 1] & 0xC0) == 0x80)
+        start--;
+    if (start == 0)
+        return 0;
+    unsigned char lead = data[start - 1];
+    int len = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    return (start - 1 + len <= size ? size : start - 1);
+}
+
+//returns name of the smallest cache which can hold given amount of data
+const char *GetCacheLevelName(long long bytes) {
+    const CacheSizes &caches = GetCacheSizes();
+    if (bytes <= caches.l1d) return "L1";
+    if (bytes <= caches.l2) return "L2";
+    if (bytes <= caches.l3) return "L3";
+    return "DRAM";
+}
+
+//converts prefixes of one large input, doubling size every time
+//the working set is input + output, the note shows which cache can hold it
+//it also shows if the whole LUT added to the working set does not fit into that cache (i.e. data competes with LUT)
+void RunSweepSuite() {
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        char name[64];
+        sprintf(name, "%s-%s/b3/validate/x4", GetFormatName(from), GetFormatName(to));
+        long long lutSize = (from == dfUtf8 ? 32768 * sizeof(DecoderLutEntry<true>) : 256 * sizeof(EncoderLutEntry));
+        std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, cmValidate, 4));
+
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist, "len123,russian"))
+                continue;
+            bool any = false;
+            for (long long size = 256; size <= cfg.sweepMaxSize; size *= 2)
+                any |= IsSelected("sweep", name, dist.name, size);
+            if (!any)
+                continue;
+
+            std::vector<char> input = GenerateInput(from, cfg.sweepMaxSize, dist, 13);
+            ConversionSession session(*processor);
+            std::vector<char> output(session.GetOutputSize(input.size()));
+            for (long long size = 256; size <= cfg.sweepMaxSize; size *= 2) {
+                if (!IsSelected("sweep", name, dist.name, size))
+                    continue;
+                long long bytes = AlignToCodePoint(input.data(), DMIN(size, (long long)input.size()), from);
+                ConversionResult res = session.Convert(input.data(), bytes, output.data(), output.size());
+                if (res.status != csSuccess) {
+                    printf("%s: conversion failed with status %d\n", GetFullName("sweep", name, dist.name, size).c_str(), res.status);
+                    continue;
+                }
+                long long workingSet = res.inputSize + res.outputSize;
+                const char *level = GetCacheLevelName(workingSet);
+                const char *levelWithLut = GetCacheLevelName(workingSet + lutSize);
+                char note[128];
+                sprintf(note, "[%lld KB in %s%s%s]", (workingSet + 1023) / 1024, level,
+                    (strcmp(level, levelWithLut) ? ", with LUT: " : ""), (strcmp(level, levelWithLut) ? levelWithLut : "")
+                );
+                Measure("sweep", name, dist.name, bytes, [&]() {
+                    ConversionResult r = session.Convert(input.data(), bytes, output.data(), output.size());
+                    sink = sink + r.outputSize;
+                }, note);
+            }
+        }
+    }
+}
+
+//========================================== Thrash suite =========================================
+
+//simulates other cache-heavy stages running between conversion calls (e.g. hash joins or parsing)
+static std::vector<char> thrashBuffer;
+void ThrashCaches() {
+    //write to every cache line, so that the whole caches are filled with dirty lines
+    char *ptr = thrashBuffer.data();
+    size_t size = thrashBuffer.size();
+    for (size_t i = 0; i < size; i += CACHE_LINE)
+        ptr[i]++;
+}
+
+//measures every call separately: with warm caches (calls one after another), and after thrashing caches
+//in the latter case LUT, input and output have to be loaded from memory again
+void MeasureWarmCold(const std::string &name, const char *distribution, long long bytes, const std::function<void()> &func) {
+    int samples = 5 * cfg.repetitions;
+    std::vector<double> cycles[2], speeds[2];
+    for (int cold = 0; cold < 2; cold++) {
+        for (int w = 0; w < cfg.warmupRuns; w++)
+            func();
+        for (int s = 0; s < samples; s++) {
+            if (cold)
+                ThrashCaches();
+            unsigned aux;
+            auto startTime = std::chrono::steady_clock::now();
+            uint64_t startTicks = __rdtscp(&aux);
+            func();
+            uint64_t endTicks = __rdtscp(&aux);
+            auto endTime = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(endTime - startTime).count();
+            cycles[cold].push_back(double(endTicks - startTicks) / bytes);
+            speeds[cold].push_back(bytes / DMAX(seconds, 1e-9) * 1e-9);
+        }
+    }
+    //penalty of cold call: total number of extra cycles per call
+    double warmMedian = Summarize(cycles[0]).median, coldMedian = Summarize(cycles[1]).median;
+    char note[128];
+    sprintf(note, "[cold: +%0.0lf cyc per call, x%0.2lf]", (coldMedian - warmMedian) * bytes, coldMedian / DMAX(warmMedian, 1e-9));
+    AddResult("thrash", name + "/warm", distribution, bytes, 1, cycles[0], speeds[0]);
+    AddResult("thrash", name + "/cold", distribution, bytes, 1, cycles[1], speeds[1], note);
+}
+
+//every processor with LUT (and without it for comparison), in single-stream and multi-stream versions
+void RunThrashSuite() {
+    const CacheSizes &caches = GetCacheSizes();
+    long long thrashSize = cfg.thrashSize;
+    if (thrashSize <= 0)
+        thrashSize = DMAX((long long)(caches.l2 + caches.l3) * 3 / 2, 16LL<<20);
+    thrashBuffer.assign(thrashSize, 0);
+    printf("Caches are thrashed by writing %lld KB between calls\n", thrashSize >> 10);
+
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        for (int maxB = 1; maxB <= 3; maxB++)
+            for (int mode = cmFull; mode <= cmValidate; mode++)
+                for (int mult = 1; mult <= 4; mult += 3) {
+                    char name[64];
+                    sprintf(name, "%s-%s/b%d/%s/x%d", GetFormatName(from), GetFormatName(to), maxB, GetModeName(mode), mult);
+                    std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, maxB, mode, mult));
+                    for (int d = 0; d < DistributionsCount; d++) {
+                        const Distribution &dist = Distributions[d];
+                        if (!IsDistributionSelected(dist, "russian"))
+                            continue;
+                        for (long long size : cfg.sizes) {
+                            if (!IsSelected("thrash", std::string(name) + "/warm", dist.name, size) && !IsSelected("thrash", std::string(name) + "/cold", dist.name, size))
+                                continue;
+                            std::vector<char> input = GenerateInput(from, size, dist, 13);
+                            ConversionSession session(*processor);
+                            std::vector<char> output(session.GetOutputSize(input.size()));
+                            MeasureWarmCold(name, dist.name, input.size(), [&]() {
+                                ConversionResult r = session.Convert(input.data(), input.size(), output.data(), output.size());
+                                sink = sink + r.outputSize;
+                            });
+                        }
+                    }
+                }
+    }
+    thrashBuffer.clear();
+    thrashBuffer.shrink_to_fit();
+}
+
+//========================================= Latency suite =========================================
+
+struct Quantile {
+    const char *name;
+    double level;
+};
+static const Quantile LatencyQuantiles[] = {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}};
+static const int LatencyQuantilesCount = sizeof(LatencyQuantiles) / sizeof(LatencyQuantiles[0]);
+
+//serialized reading of time stamp counter:
+//measured code cannot start before the first reading, and cannot be still running at the second reading
+static FORCEINLINE uint64_t ReadTicksBefore() {
+    _mm_lfence();
+    uint64_t res = __rdtsc();
+    _mm_lfence();
+    return res;
+}
+static FORCEINLINE uint64_t ReadTicksAfter() {
+    unsigned aux;
+    uint64_t res = __rdtscp(&aux);
+    _mm_lfence();
+    return res;
+}
+
+//frequency of time stamp counter (GHz), and median cost of empty measurement (cycles)
+static double tscFrequency = 0.0;
+static double timerOverhead = 0.0;
+void CalibrateTimer() {
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t startTicks = __rdtsc();
+    double seconds;
+    do {
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    } while (seconds < 0.1);
+    tscFrequency = (__rdtsc() - startTicks) / seconds * 1e-9;
+
+    std::vector<double> empty;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t start = ReadTicksBefore();
+        uint64_t end = ReadTicksAfter();
+        empty.push_back(double(end - start));
+    }
+    timerOverhead = Summarize(empty).median;
+}
+
+//times every call separately, calls convert messages from a pool one after another
+//timer overhead is subtracted, percentiles of cycles per call are reported
+void MeasureLatency(const std::string &name, const char *distribution,
+    const std::vector<std::vector<char>> &messages, const std::function<void(const std::vector<char> &)> &func
+) {
+    int count = int(messages.size());
+    long long totalBytes = 0;
+    for (int i = 0; i < count; i++)
+        totalBytes += messages[i].size();
+    double avgBytes = DMAX(double(totalBytes) / count, 1.0);
+
+    for (int w = 0; w < cfg.warmupRuns; w++)
+        for (int i = 0; i < count; i++)
+            func(messages[i]);
+    std::vector<double> callCycles, cycles, speeds;
+    for (int s = 0; s < cfg.latencySamples; s++) {
+        const std::vector<char> &msg = messages[s % count];
+        uint64_t startTicks = ReadTicksBefore();
+        func(msg);
+        uint64_t endTicks = ReadTicksAfter();
+        double elapsed = DMAX(double(endTicks - startTicks) - timerOverhead, 1.0);
+        callCycles.push_back(elapsed);
+        cycles.push_back(elapsed / DMAX(msg.size(), 1));
+        speeds.push_back(msg.size() / elapsed * tscFrequency);
+    }
+
+    std::sort(callCycles.begin(), callCycles.end());
+    std::vector<double> percentiles;
+    std::string note = "[cyc per call:";
+    for (int q = 0; q < LatencyQuantilesCount; q++) {
+        size_t idx = DMIN(size_t(LatencyQuantiles[q].level * callCycles.size()), callCycles.size() - 1);
+        percentiles.push_back(callCycles[idx]);
+        char buff[64];
+        sprintf(buff, " %s %0.0lf", LatencyQuantiles[q].name, callCycles[idx]);
+        note += buff;
+    }
+    note += "]";
+    AddResult("latency", name, distribution, (long long)avgBytes, 1, cycles, speeds, note);
+    allResults.back().percentiles = percentiles;
+}
+
+//one-shot functions from iconv interface, indexed as Directions
+typedef size_t (*IconvWholeFunc)(const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+static const IconvWholeFunc IconvWholeFuncs[4] = {iconv_u8l_utf8_to_utf16, iconv_u8l_utf8_to_utf32, iconv_u8l_utf16_to_utf8, iconv_u8l_utf32_to_utf8};
+const char *GetIconvName(int format) {
+    return format == dfUtf8 ? "UTF-8" : format == dfUtf16 ? "UTF-16LE" : "UTF-32LE";
+}
+
+//every processor config via ConvertInMemory, and iconv interface (with descriptor and one-shot)
+//many messages of the same size are generated, so that branch predictor cannot learn one of them
+void RunLatencySuite() {
+    static const int MessagesCount = 64;
+    std::vector<long long> sizes = cfg.sizes;
+    if (!cfg.sizesGiven) {
+        sizes.clear();
+        for (long long size = 16; size <= 4096; size *= 2)
+            sizes.push_back(size);
+    }
+    CalibrateTimer();
+    printf("Latency: %d calls per benchmark, TSC frequency %0.2lf GHz, timer overhead %0.0lf cycles (subtracted)\n",
+        cfg.latencySamples, tscFrequency, timerOverhead
+    );
+
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        char prefix[64];
+        sprintf(prefix, "%s-%s/", GetFormatName(from), GetFormatName(to));
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist, "russian"))
+                continue;
+            for (long long size : sizes) {
+                std::vector<std::vector<char>> messages;
+                for (int i = 0; i < MessagesCount; i++)
+                    messages.push_back(GenerateInput(from, size, dist, 100 + i));
+
+                for (int maxB = 0; maxB <= 3; maxB++)
+                    for (int mode = (maxB ? cmFast : cmValidate); mode <= cmValidate; mode++)
+                        for (int mult = 1; mult <= (maxB ? 4 : 1); mult += 3) {
+                            if (mode == cmFast && dist.GetMaxLen() > maxB)
+                                continue;
+                            char name[128];
+                            snprintf(name, sizeof(name), "%sb%d/%s/x%d", prefix, maxB, GetModeName(mode), mult);
+                            if (!IsSelected("latency", name, dist.name, size))
+                                continue;
+                            std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, maxB, mode, mult));
+                            std::vector<char> output(ConvertInMemorySize(*processor, size));
+                            MeasureLatency(name, dist.name, messages, [&](const std::vector<char> &msg) {
+                                ConversionResult r = ConvertInMemory(*processor, msg.data(), msg.size(), output.data(), output.size());
+                                sink = sink + r.outputSize;
+                            });
+                        }
+
+                std::string name = std::string(prefix) + "iconv";
+                if (IsSelected("latency", name, dist.name, size)) {
+                    iconv_t cd = iconv_open(GetIconvName(to), GetIconvName(from));
+                    //extension: ask for output size enough for any input of given size
+                    size_t inLeft = size, outSize = 0;
+                    const char *dummy = "";
+                    iconv(cd, &dummy, &inLeft, 0, &outSize);
+                    std::vector<char> output(outSize);
+                    MeasureLatency(name, dist.name, messages, [&](const std::vector<char> &msg) {
+                        const char *src = msg.data();
+                        char *dst = output.data();
+                        size_t srcLeft = msg.size(), dstLeft = output.size();
+                        sink = sink + iconv(cd, &src, &srcLeft, &dst, &dstLeft);
+                    });
+                    iconv_close(cd);
+                }
+
+                name = std::string(prefix) + "iconv_u8l";
+                if (IsSelected("latency", name, dist.name, size)) {
+                    IconvWholeFunc func = IconvWholeFuncs[dir];
+                    size_t inLeft = size, outSize = 0;
+                    const char *dummy = "";
+                    func(&dummy, &inLeft, 0, &outSize);
+                    std::vector<char> output(outSize);
+                    MeasureLatency(name, dist.name, messages, [&](const std::vector<char> &msg) {
+                        const char *src = msg.data();
+                        char *dst = output.data();
+                        size_t srcLeft = msg.size(), dstLeft = output.size();
+                        sink = sink + func(&src, &srcLeft, &dst, &dstLeft);
+                    });
+                }
+            }
+        }
+    }
+}
+
+//========================================= Scaling suite =========================================
+
+// Logical CPUs available to the process, grouped by physical cores (SMT siblings are in one group).
+struct CpuTopology {
+    std::vector<std::vector<int>> cores;
+    int logicalCount;
+};
+
+CpuTopology GetCpuTopology() {
+    CpuTopology res;
+    res.logicalCount = 0;
+#if defined(_WIN32)
+    DWORD_PTR processMask, systemMask;
+    GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+    DWORD length = 0;
+    GetLogicalProcessorInformation(NULL, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION) + 1);
+    if (length > 0 && GetLogicalProcessorInformation(infos.data(), &length)) {
+        for (size_t i = 0; i < length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); i++) {
+            if (infos[i].Relationship != RelationProcessorCore)
+                continue;
+            std::vector<int> core;
+            for (int b = 0; b < int(8 * sizeof(ULONG_PTR)); b++)
+                if ((infos[i].ProcessorMask & processMask) & (ULONG_PTR(1) << b))
+                    core.push_back(b);
+            if (!core.empty())
+                res.cores.push_back(core);
+        }
+    }
+#elif defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        std::vector<std::pair<int, int>> keys;     //(package, core) of every group
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            std::pair<int, int> key(-1, cpu);
+            const char *names[2] = {"physical_package_id", "core_id"};
+            int *values[2] = {&key.first, &key.second};
+            for (int k = 0; k < 2; k++) {
+                char path[256];
+                sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, names[k]);
+                if (FILE *f = fopen(path, "rt")) {
+                    if (fscanf(f, "%d", values[k]) != 1)
+                        *values[k] = (k ? cpu : -1);
+                    fclose(f);
+                }
+            }
+            size_t idx = std::find(keys.begin(), keys.end(), key) - keys.begin();
+            if (idx == keys.size()) {
+                keys.push_back(key);
+                res.cores.push_back(std::vector<int>());
+            }
+            res.cores[idx].push_back(cpu);
+        }
+    }
+#endif
+    if (res.cores.empty()) {
+        //unknown topology: every logical CPU is considered a separate core
+        int count = DMAX(int(std::thread::hardware_concurrency()), 1);
+        for (int cpu = 0; cpu < count; cpu++)
+            res.cores.push_back(std::vector<int>(1, cpu));
+    }
+    for (size_t i = 0; i < res.cores.size(); i++)
+        res.logicalCount += int(res.cores[i].size());
+    return res;
+}
+
+//returns logical CPUs in the order in which threads should be placed on them:
+//  compact: fill all SMT siblings of a core before going to the next core
+//  spread:  one thread per physical core first, SMT siblings are used only after all cores are busy
+std::vector<int> GetCpuPlacement(const CpuTopology &topology, bool compact) {
+    std::vector<int> res;
+    if (compact) {
+        for (size_t i = 0; i < topology.cores.size(); i++)
+            res.insert(res.end(), topology.cores[i].begin(), topology.cores[i].end());
+        return res;
+    }
+    for (size_t r = 0; int(res.size()) < topology.logicalCount; r++)
+        for (size_t i = 0; i < topology.cores.size(); i++)
+            if (r < topology.cores[i].size())
+                res.push_back(topology.cores[i][r]);
+    return res;
+}
+
+//binds the calling thread to given logical CPU (failure is ignored)
+void PinCurrentThread(int cpu) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+//runs func(index) on 'count' threads pinned according to 'placement'
+//all threads are created and pinned before time measurement starts
+//returns wall time from start signal until the last thread finishes
+double RunPinnedThreads(int count, const std::vector<int> &placement, const std::function<void(int)> &func, uint64_t *ticks = 0) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < count; t++)
+        threads.emplace_back([&, t]() {
+            PinCurrentThread(placement[t % placement.size()]);
+            ready++;
+            while (!start.load())
+                std::this_thread::yield();
+            func(t);
+        });
+    while (ready.load() < count)
+        std::this_thread::yield();
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t startTicks = __rdtsc();
+    start = true;
+    for (int t = 0; t < count; t++)
+        threads[t].join();
+    uint64_t endTicks = __rdtsc();
+    auto endTime = std::chrono::steady_clock::now();
+    if (ticks)
+        *ticks = endTicks - startTicks;
+    return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+// State of one thread in scaling suite.
+struct ScalingWorker {
+    std::unique_ptr<BaseBufferProcessor> processor;
+    const char *input;
+    long long inputSize;
+    char *output;
+    long long outputSize;
+    std::vector<char> ownInput, ownOutput;  //used only in "separate" mode
+    ConversionStatus status;
+    long long outputTotal;      //sum of output sizes over passes (added to sink after threads join)
+};
+
+//every thread converts its own part of data with its own processor
+//  separate: every thread allocates and fills its buffers itself (so memory is local to its NUMA node)
+//  chunks:   one large input and one large output are allocated by main thread, threads convert disjoint chunks
+//the same data is converted in both modes, amount of data grows with number of threads (weak scaling)
+//efficiency shows speed per thread relative to speed per thread on the smallest number of threads
+void RunScalingSuite() {
+    CpuTopology topology = GetCpuTopology();
+    std::vector<long long> counts = cfg.threads;
+    if (counts.empty()) {
+        for (int n = 1; n < topology.logicalCount; n *= 2)
+            counts.push_back(n);
+        counts.push_back(topology.logicalCount);
+    }
+    int maxCount = int(*std::max_element(counts.begin(), counts.end()));
+    bool hasSmt = (topology.logicalCount > int(topology.cores.size()));
+    printf("Scaling: %d logical CPUs on %d physical cores, %lld KB of input per thread\n",
+        topology.logicalCount, int(topology.cores.size()), cfg.threadSize >> 10
+    );
+    if (!hasSmt)
+        printf("No SMT detected: compact placement is the same as spread, so it is skipped\n");
+
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist, "russian"))
+                continue;
+            std::vector<char> input;
+            std::vector<char> output;
+            std::vector<long long> chunkStarts;
+            long long chunkOutputSize = 0;
+
+            for (int separate = 1; separate >= 0; separate--)
+                for (int compact = 0; compact <= (hasSmt ? 1 : 0); compact++) {
+                    std::vector<int> placement = GetCpuPlacement(topology, compact != 0);
+                    double baseSpeed = 0.0;
+                    for (long long count : counts) {
+                        int n = int(count);
+                        char name[64];
+                        sprintf(name, "%s-%s/%s/%s/t%d", GetFormatName(from), GetFormatName(to),
+                            (separate ? "separate" : "chunks"), (compact ? "compact" : "spread"), n
+                        );
+                        if (!IsSelected("scaling", name, dist.name, cfg.threadSize * n))
+                            continue;
+                        if (input.empty()) {
+                            //generated lazily: it may take a lot of memory
+                            input = GenerateInput(from, cfg.threadSize * maxCount, dist, 13);
+                            for (int t = 0; t <= maxCount; t++)
+                                chunkStarts.push_back(AlignToCodePoint(input.data(), DMIN(cfg.threadSize * t, (long long)input.size()), from));
+                            std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, cmValidate, 4));
+                            chunkOutputSize = ConversionSession(*processor).GetOutputSize(cfg.threadSize);
+                            output.resize(chunkOutputSize * maxCount);
+                        }
+
+                        //setup: every thread creates its processor and buffers, then converts data once
+                        std::vector<ScalingWorker> workers(n);
+                        RunPinnedThreads(n, placement, [&](int t) {
+                            ScalingWorker &w = workers[t];
+                            w.processor.reset(GenerateProcessor(from, to, 3, cmValidate, 4));
+                            w.input = input.data() + chunkStarts[t];
+                            w.inputSize = chunkStarts[t + 1] - chunkStarts[t];
+                            w.output = output.data() + chunkOutputSize * t;
+                            w.outputSize = chunkOutputSize;
+                            if (separate) {
+                                w.ownInput.assign(w.input, w.input + w.inputSize);
+                                w.ownOutput.assign(w.outputSize, 0);
+                                w.input = w.ownInput.data();
+                                w.output = w.ownOutput.data();
+                            }
+                            w.status = ConvertInMemory(*w.processor, w.input, w.inputSize, w.output, w.outputSize).status;
+                        });
+                        long long totalBytes = 0;
+                        bool ok = true;
+                        for (int t = 0; t < n; t++) {
+                            totalBytes += workers[t].inputSize;
+                            ok &= (workers[t].status == csSuccess);
+                        }
+                        if (!ok) {
+                            printf("%s: conversion failed\n", GetFullName("scaling", name, dist.name, cfg.threadSize * n).c_str());
+                            continue;
+                        }
+
+                        long long passes = DMAX(cfg.minBytesPerSample / cfg.threadSize, 1);
+                        auto func = [&](int t) {
+                            ScalingWorker &w = workers[t];
+                            long long total = 0;
+                            for (long long p = 0; p < passes; p++) {
+                                ConversionResult r = ConvertInMemory(*w.processor, w.input, w.inputSize, w.output, w.outputSize);
+                                total += r.outputSize;
+                            }
+                            w.outputTotal = total;
+                        };
+                        //shared sink is touched only by main thread, so that threads do not race for it
+                        auto consume = [&]() {
+                            for (int t = 0; t < n; t++)
+                                sink = sink + workers[t].outputTotal;
+                        };
+                        for (int r = 0; r < cfg.warmupRuns; r++) {
+                            RunPinnedThreads(n, placement, func);
+                            consume();
+                        }
+                        std::vector<double> cycles, speeds;
+                        for (int r = 0; r < cfg.repetitions; r++) {
+                            uint64_t ticks;
+                            double seconds = RunPinnedThreads(n, placement, func, &ticks);
+                            consume();
+                            cycles.push_back(double(ticks) / (totalBytes * passes));
+                            speeds.push_back(totalBytes * passes / DMAX(seconds, 1e-9) * 1e-9);
+                        }
+
+                        double speed = Summarize(speeds).median;
+                        if (baseSpeed == 0.0)
+                            baseSpeed = speed / n;
+                        long long workingSet = totalBytes + chunkOutputSize * n;
+                        char note[128];
+                        sprintf(note, "[%0.3lf GB/s per thread, efficiency %0.0lf%%, %lld MB in %s]",
+                            speed / n, 100.0 * speed / n / baseSpeed, workingSet >> 20, GetCacheLevelName(workingSet)
+                        );
+                        AddResult("scaling", name, dist.name, totalBytes, passes, cycles, speeds, note);
+                    }
+                }
+        }
+    }
+}
+
+//========================================= Compare suite =========================================
+
+// iconv from C library of the system, loaded dynamically.
+// Note that this executable defines its own iconv functions (from iconv/iconv.cpp),
+// so the system ones are taken explicitly from the C library.
+struct SystemIconv {
+    typedef void *(*OpenFunc)(const char *tocode, const char *fromcode);
+    typedef size_t (*ConvertFunc)(void *cd, char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+    typedef int (*CloseFunc)(void *cd);
+    OpenFunc open;
+    ConvertFunc convert;
+    CloseFunc close;
+};
+
+//returns false if system iconv is not available
+bool LoadSystemIconv(SystemIconv &res) {
+#ifdef _WIN32
+    return false;
+#else
+    void *library = dlopen("libc.so.6", RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+        return false;
+    res.open = (SystemIconv::OpenFunc)dlsym(library, "iconv_open");
+    res.convert = (SystemIconv::ConvertFunc)dlsym(library, "iconv");
+    res.close = (SystemIconv::CloseFunc)dlsym(library, "iconv_close");
+    return res.open && res.convert && res.close;
+#endif
+}
+
+//scalar DFA-based conversion from the slow path, used as reference
+bool ConvertTrivial(int srcFormat, int dstFormat, const char *input, long long inputSize, char *output, long long &outputSize) {
+    const char *src = input;
+    char *dst = output;
+    bool ok;
+    if (srcFormat == dfUtf8)
+        ok = (dstFormat == dfUtf16 ? DecodeTrivial<2>(src, input + inputSize, dst) : DecodeTrivial<4>(src, input + inputSize, dst));
+    else
+        ok = (srcFormat == dfUtf16 ? EncodeTrivial<2>(src, input + inputSize, dst) : EncodeTrivial<4>(src, input + inputSize, dst));
+    outputSize = dst - output;
+    return ok && src == input + inputSize;
+}
+
+// One implementation of conversion compared in this suite.
+// It converts the whole input into output, returns false on failure.
+struct Engine {
+    std::string name;
+    std::function<bool(const char *, long long, char *, long long, long long &)> convert;
+};
+
+//the same inputs are converted by every engine, outputs must be identical to the output of scalar DFA
+//any mismatch is reported, and the note of the engine's result says so
+void RunCompareSuite() {
+    SystemIconv system = {};
+    bool hasSystem = LoadSystemIconv(system);
+    printf("System iconv: %s\n", (hasSystem ? "loaded from C library" : "not available"));
+
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        char prefix[64];
+        sprintf(prefix, "%s-%s/", GetFormatName(from), GetFormatName(to));
+
+        std::vector<Engine> engines;
+        std::vector<std::shared_ptr<BaseBufferProcessor>> processors;
+        for (int mult = 1; mult <= 4; mult += 3) {
+            std::shared_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, cmValidate, mult));
+            processors.push_back(processor);
+            char name[64];
+            sprintf(name, "utf8lut-b3-validate-x%d", mult);
+            engines.push_back({name, [processor](const char *in, long long inSize, char *out, long long outSize, long long &written) {
+                ConversionSession session(*processor);
+                ConversionResult r = session.Convert(in, inSize, out, outSize);
+                written = r.outputSize;
+                return r.status == csSuccess;
+            }});
+        }
+        IconvWholeFunc wholeFunc = IconvWholeFuncs[dir];
+        engines.push_back({"iconv_u8l", [wholeFunc](const char *in, long long inSize, char *out, long long outSize, long long &written) {
+            size_t inLeft = size_t(inSize), outLeft = size_t(outSize);
+            size_t res = wholeFunc(&in, &inLeft, &out, &outLeft);
+            written = outSize - (long long)outLeft;
+            return res != (size_t)-1 && inLeft == 0;
+        }});
+        void *systemCd = (hasSystem ? system.open(GetIconvName(to), GetIconvName(from)) : (void*)-1);
+        if (systemCd != (void*)-1) {
+            SystemIconv::ConvertFunc convertFunc = system.convert;
+            engines.push_back({"system-iconv", [convertFunc, systemCd](const char *in, long long inSize, char *out, long long outSize, long long &written) {
+                char *src = (char*)in;
+                size_t inLeft = size_t(inSize), outLeft = size_t(outSize);
+                size_t res = convertFunc(systemCd, &src, &inLeft, &out, &outLeft);
+                written = outSize - (long long)outLeft;
+                return res != (size_t)-1 && inLeft == 0;
+            }});
+        }
+        engines.push_back({"trivial", [from, to](const char *in, long long inSize, char *out, long long /*outSize*/, long long &written) {
+            return ConvertTrivial(from, to, in, inSize, out, written);
+        }});
+
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist))
+                continue;
+            for (long long size : cfg.sizes) {
+                std::vector<char> input = GenerateInput(from, size, dist, 13);
+                long long inputSize = input.size();
+                //enough for any engine: one input byte never produces more than 4 output bytes
+                long long outputSize = DMAX(4 * inputSize, ConversionSession(*processors.back()).GetOutputSize(inputSize));
+                std::vector<char> reference(outputSize);
+                long long referenceSize = 0;
+                if (!ConvertTrivial(from, to, input.data(), inputSize, reference.data(), referenceSize)) {
+                    printf("%s: reference conversion failed\n", GetFullName("compare", prefix, dist.name, size).c_str());
+                    continue;
+                }
+
+                for (size_t e = 0; e < engines.size(); e++) {
+                    const Engine &engine = engines[e];
+                    std::string name = prefix + engine.name;
+                    if (!IsSelected("compare", name, dist.name, size))
+                        continue;
+                    std::vector<char> output(outputSize);
+                    long long written = 0;
+                    bool ok = engine.convert(input.data(), inputSize, output.data(), outputSize, written);
+                    bool same = ok && written == referenceSize && memcmp(output.data(), reference.data(), size_t(written)) == 0;
+                    if (!same)
+                        printf("%s: output differs from scalar DFA (%s)\n", GetFullName("compare", name, dist.name, size).c_str(), (ok ? "mismatch" : "failed"));
+                    Measure("compare", name, dist.name, inputSize, [&]() {
+                        long long w;
+                        engine.convert(input.data(), inputSize, output.data(), outputSize, w);
+                        sink = sink + w;
+                    }, (same ? "" : "[output differs]"));
+                }
+            }
+        }
+        if (systemCd != (void*)-1)
+            system.close(systemCd);
+    }
+}
+
+//========================================== Files suite ==========================================
+
+//returns max length of code points in UTF-8, or 5 if input contains invalid data
+int GetMaxCodePointLength(const std::vector<char> &input, int format) {
+    std::vector<char> output(4 * input.size() + 16);
+    long long outputSize;
+    int to = (format == dfUtf8 ? dfUtf32 : dfUtf8);
+    if (!ConvertTrivial(format, to, input.data(), input.size(), output.data(), outputSize))
+        return 5;
+    long long hist[4] = {0};
+    if (format == dfUtf8)
+        CountCodePointLengths<1>(input.data(), input.data() + input.size(), hist);
+    else if (format == dfUtf16)
+        CountCodePointLengths<2>(input.data(), input.data() + input.size(), hist);
+    else
+        CountCodePointLengths<4>(input.data(), input.data() + input.size(), hist);
+    int res = 0;
+    for (int i = 0; i < 4; i++)
+        if (hist[i])
+            res = i + 1;
+    return res;
+}
+
+//converts every file from --files with every processor which supports its direction and contents
+//file name (without directory) is used instead of distribution name in results
+void RunFilesSuite() {
+    if (!cfg.files) {
+        printf("No input files specified for files suite (see --files)\n");
+        return;
+    }
+    std::string list = cfg.files;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string path = list.substr(pos, end - pos);
+        pos = end + 1;
+        std::string fileName = path.substr(path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\") + 1);
+
+        int dir = -1;
+        for (int d = 0; d < 4; d++)
+            if (fileName.find(std::string(GetFormatName(Directions[d][0])) + "-" + GetFormatName(Directions[d][1])) != std::string::npos)
+                dir = d;
+        if (dir < 0) {
+            printf("%s: cannot determine direction of conversion from file name\n", path.c_str());
+            continue;
+        }
+        int from = Directions[dir][0], to = Directions[dir][1];
+
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f) {
+            printf("Cannot open file: %s\n", path.c_str());
+            continue;
+        }
+        std::vector<char> input;
+        char chunk[1<<16];
+        while (size_t cnt = fread(chunk, 1, sizeof(chunk), f))
+            input.insert(input.end(), chunk, chunk + cnt);
+        fclose(f);
+        int maxLen = GetMaxCodePointLength(input, from);
+
+        for (int maxB = 0; maxB <= 3; maxB++)
+            for (int mode = (maxB ? cmFast : cmValidate); mode <= cmValidate; mode++)
+                for (int mult = 1; mult <= (maxB ? 4 : 1); mult += 3) {
+                    if (mode != cmValidate && maxLen > 4)
+                        continue;   //invalid input is supported only with validation
+                    if (mode == cmFast && maxLen > maxB)
+                        continue;
+                    char name[64];
+                    sprintf(name, "%s-%s/b%d/%s/x%d", GetFormatName(from), GetFormatName(to), maxB, GetModeName(mode), mult);
+                    if (!IsSelected("files", name, fileName.c_str(), input.size()))
+                        continue;
+                    std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, maxB, mode, mult));
+                    ConversionSession session(*processor);
+                    std::vector<char> output(session.GetOutputSize(input.size()));
+                    Measure("files", name, fileName.c_str(), input.size(), [&]() {
+                        ConversionResult r = session.Convert(input.data(), input.size(), output.data(), output.size());
+                        sink = sink + r.outputSize;
+                    });
+                }
+    }
+}
+
+//========================================= Roofline suite ========================================
+
+//returns median speed of memcpy in GB/s of memory traffic (bytes read + bytes written)
+//source and destination have 'size' bytes each
+double MeasureCopySpeed(long long size, bool nonTemporal) {
+    std::vector<char> src(size + CACHE_LINE, 1), dst(size + CACHE_LINE, 0);
+    //both buffers aligned: then non-temporal stores go without head copy
+    char *srcPtr = (char*)ALIGNDOWN(size_t(src.data()) + CACHE_LINE - 1, CACHE_LINE);
+    char *dstPtr = (char*)ALIGNDOWN(size_t(dst.data()) + CACHE_LINE - 1, CACHE_LINE);
+    long long calls = DMAX(cfg.minBytesPerSample / size, 1);
+    auto func = [&]() {
+        if (nonTemporal)
+            StreamingMemcpy(dstPtr, srcPtr, size);
+        else
+            CustomMemcpy_t_t(dstPtr, srcPtr, size);
+    };
+    for (int w = 0; w < cfg.warmupRuns; w++)
+        for (long long c = 0; c < calls; c++)
+            func();
+    std::vector<double> speeds;
+    for (int r = 0; r < cfg.repetitions; r++) {
+        auto startTime = std::chrono::steady_clock::now();
+        for (long long c = 0; c < calls; c++)
+            func();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        speeds.push_back(2.0 * size * calls / DMAX(seconds, 1e-9) * 1e-9);
+    }
+    sink = sink + dstPtr[size / 2];
+    return Summarize(speeds).median;
+}
+
+//every direction is compared to the copy bound: time needed to read its input and write its output at memcpy speed
+//memcpy is measured with the same amount of traffic (half of it read, half written), the faster of two variants is taken
+//conversion reaching most of the copy bound is memory-bound, otherwise it is compute-bound
+//every conversion is measured with both ordinary and streaming stores of output (see SetOutputStoreMode)
+void RunRooflineSuite() {
+    static const double MemoryBoundLevel = 0.7;
+    static const struct { const char *name; int mode; } StoreModes[] = {
+        {"temporal", BaseBufferProcessor::osTemporal},
+        {"streaming", BaseBufferProcessor::osStreaming},
+    };
+    std::vector<long long> sizes = cfg.sizes;
+    if (!cfg.sizesGiven)
+        sizes = {1<<16, 1<<20, 1<<24, 1<<26};
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, cmValidate, 4));
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist, "len123,russian"))
+                continue;
+            for (long long size : sizes) {
+                std::vector<char> input;
+                long long traffic = 0;
+                double copyT = 0.0, copyNT = 0.0, temporalSpeed = 0.0;
+                for (const auto &store : StoreModes) {
+                    char name[64];
+                    sprintf(name, "%s-%s/b3/validate/x4/%s", GetFormatName(from), GetFormatName(to), store.name);
+                    if (!IsSelected("roofline", name, dist.name, size))
+                        continue;
+                    processor->SetOutputStoreMode(store.mode);
+                    if (input.empty())
+                        input = GenerateInput(from, size, dist, 13);
+                    ConversionSession session(*processor);
+                    std::vector<char> output(session.GetOutputSize(input.size()));
+                    ConversionResult res = session.Convert(input.data(), input.size(), output.data(), output.size());
+                    if (res.status != csSuccess) {
+                        printf("%s: conversion failed with status %d\n", GetFullName("roofline", name, dist.name, size).c_str(), res.status);
+                        continue;
+                    }
+                    if (traffic == 0) {
+                        traffic = res.inputSize + res.outputSize;
+                        copyT = MeasureCopySpeed(traffic / 2, false);
+                        copyNT = MeasureCopySpeed(traffic / 2, true);
+                    }
+                    //conversion speed is measured in input bytes, the bound too
+                    double boundSpeed = DMAX(copyT, copyNT) * res.inputSize / traffic;
+
+                    size_t first = allResults.size();
+                    Measure("roofline", name, dist.name, input.size(), [&]() {
+                        ConversionResult r = session.Convert(input.data(), input.size(), output.data(), output.size());
+                        sink = sink + r.outputSize;
+                    });
+                    if (allResults.size() == first)
+                        continue;
+                    BenchResult &added = allResults.back();
+                    double speed = added.gigabytesPerSec.median;
+                    double ratio = speed / DMAX(boundSpeed, 1e-9);
+                    char note[256];
+                    int len = sprintf(note, "[memcpy: %0.2lf GB/s (t), %0.2lf GB/s (nt), bound: %0.3lf GB/s, reached %0.0lf%%: %s]",
+                        copyT, copyNT, boundSpeed, 100.0 * ratio, (ratio >= MemoryBoundLevel ? "memory-bound" : "compute-bound")
+                    );
+                    if (store.mode == BaseBufferProcessor::osTemporal)
+                        temporalSpeed = speed;
+                    else {
+                        //every output cache line written with ordinary stores is read from memory first
+                        len += sprintf(note + len, " [read-for-ownership avoided: %0.2lf MB per call", res.outputSize / 1048576.0);
+                        if (temporalSpeed > 0.0)
+                            len += sprintf(note + len, ", %+0.1lf%% vs temporal", 100.0 * (speed / temporalSpeed - 1.0));
+                        len += sprintf(note + len, "]");
+                    }
+                    added.note = note;
+                    printf("    %s\n", note);
+                }
+            }
+        }
+    }
+}
+
+//========================================= File IO suite =========================================
+
+static const struct { const char *name; FileIOType type; long long windowSize; } FileIOTypes[] = {
+    {"libc", ftLibC, 0},
+    {"mmap", ftMemoryMapWhole, 0},
+    {"mmapwin16M", ftMemoryMapWindowed, 1<<24},
+    {"async", ftPosixAsync, 0},
+};
+
+bool WriteWholeFile(const char *path, const char *data, long long size) {
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = (fwrite(data, 1, size_t(size), f) == size_t(size));
+    return fclose(f) == 0 && ok;
+}
+
+bool ReadWholeFile(const char *path, std::vector<char> &data) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    data.clear();
+    char chunk[1<<16];
+    size_t cnt;
+    while ((cnt = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + cnt);
+    fclose(f);
+    return true;
+}
+
+//converts input file into output file in the current directory with ConvertFile
+//note: both files stay in OS page cache, so the suite measures overhead of IO functions, not speed of disk
+//output of every IO type is checked against in-memory conversion
+void RunFileIOSuite() {
+    static const char *InputPath = "bench_fileio_input.tmp";
+    static const char *OutputPath = "bench_fileio_output.tmp";
+    std::vector<long long> sizes = cfg.sizes;
+    if (!cfg.sizesGiven)
+        sizes = {1<<20, 1<<26};
+    for (int dir = 0; dir < 4; dir++) {
+        int from = Directions[dir][0], to = Directions[dir][1];
+        std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, cmValidate, 4));
+        for (int d = 0; d < DistributionsCount; d++) {
+            const Distribution &dist = Distributions[d];
+            if (!IsDistributionSelected(dist, "russian"))
+                continue;
+            for (long long size : sizes) {
+                std::vector<char> input, reference;
+                for (const auto &io : FileIOTypes) {
+                    char name[64];
+                    sprintf(name, "%s-%s/b3/validate/x4/%s", GetFormatName(from), GetFormatName(to), io.name);
+                    if (!IsSelected("fileio", name, dist.name, size))
+                        continue;
+                    if (input.empty()) {
+                        input = GenerateInput(from, size, dist, 13);
+                        reference.resize(ConvertInMemorySize(*processor, input.size()));
+                        ConversionResult res = ConvertInMemory(*processor, input.data(), input.size(), reference.data(), reference.size());
+                        reference.resize(res.outputSize);
+                        if (!WriteWholeFile(InputPath, input.data(), input.size())) {
+                            printf("Cannot write file: %s\n", InputPath);
+                            return;
+                        }
+                    }
+                    ConvertFilesSettings settings;
+                    settings.type = io.type;
+                    settings.windowSize = io.windowSize;
+                    ConversionResult res = ConvertFile(*processor, InputPath, OutputPath, settings);
+                    if (res.status == csNotImplemented) {
+                        printf("%s: not implemented on this platform\n", GetFullName("fileio", name, dist.name, size).c_str());
+                        continue;
+                    }
+                    std::vector<char> output;
+                    bool same = res.status == csSuccess && ReadWholeFile(OutputPath, output) && output == reference;
+                    if (!same)
+                        printf("%s: output differs from in-memory conversion (status %d)\n", GetFullName("fileio", name, dist.name, size).c_str(), res.status);
+                    Measure("fileio", name, dist.name, input.size(), [&]() {
+                        ConversionResult r = ConvertFile(*processor, InputPath, OutputPath, settings);
+                        sink = sink + r.outputSize;
+                    }, (same ? "" : "[output differs]"));
+                }
+            }
+        }
+    }
+    remove(InputPath);
+    remove(OutputPath);
+}
+
+//============================================= Output ============================================
+
+std::string GetCpuName() {
+    unsigned regs[12] = {0};
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if (unsigned(info[0]) < 0x80000004U)
+        return "unknown";
+    for (int i = 0; i < 3; i++)
+        __cpuid((int*)&regs[4*i], 0x80000002 + i);
+#else
+    if (__get_cpuid_max(0x80000000U, 0) < 0x80000004U)
+        return "unknown";
+    for (int i = 0; i < 3; i++)
+        __get_cpuid(0x80000002U + i, &regs[4*i+0], &regs[4*i+1], &regs[4*i+2], &regs[4*i+3]);
+#endif
+    char name[49] = {0};
+    memcpy(name, regs, 48);
+    std::string res = name;
+    //trim spaces and remove quotes
+    res.erase(std::remove(res.begin(), res.end(), '"'), res.end());
+    while (!res.empty() && res[0] == ' ')
+        res.erase(res.begin());
+    while (!res.empty() && res.back() == ' ')
+        res.pop_back();
+    return res;
+}
+
+//samples of benchmarks with many repetitions (e.g. latency) are not saved
+static const size_t MaxSavedSamples = 1000;
+
+//escapes string for JSON (names of files from command line may contain quotes and backslashes)
+std::string EscapeJsonString(const std::string &str) {
+    std::string res;
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\') {
+            res += '\\';
+            res += char(c);
+        }
+        else if (c < 0x20) {
+            char buff[8];
+            sprintf(buff, "\\u%04x", c);
+            res += buff;
+        }
+        else
+            res += char(c);
+    }
+    return res;
+}
+
+void WriteSummaryJson(FILE *f, const char *key, const Summary &s) {
+    fprintf(f, "\"%s\": {\"median\": %0.6lf, \"mad\": %0.6lf, \"min\": %0.6lf, \"max\": %0.6lf}", key, s.median, s.mad, s.min, s.max);
+}
+
+bool WriteResultsJson(const char *path) {
+    FILE *f = fopen(path, "wt");
+    if (!f)
+        return false;
+    const CacheSizes &caches = GetCacheSizes();
+    fprintf(f, "{\n");
+    fprintf(f, "  \"machine\": {\"cpu\": \"%s\", \"l1d\": %d, \"l2\": %d, \"l3\": %d},\n", EscapeJsonString(GetCpuName()).c_str(), caches.l1d, caches.l2, caches.l3);
+    fprintf(f, "  \"settings\": {\"warmup\": %d, \"repetitions\": %d, \"minbytes\": %lld},\n", cfg.warmupRuns, cfg.repetitions, cfg.minBytesPerSample);
+    fprintf(f, "  \"results\": [");
+    for (size_t i = 0; i < allResults.size(); i++) {
+        const BenchResult &res = allResults[i];
+        fprintf(f, "%s\n    {\"suite\": \"%s\", \"name\": \"%s\", \"distribution\": \"%s\", \"size\": %lld, \"calls\": %lld, ",
+            (i ? "," : ""), EscapeJsonString(res.suite).c_str(), EscapeJsonString(res.name).c_str(), EscapeJsonString(res.distribution).c_str(), res.size, res.calls
+        );
+        WriteSummaryJson(f, "cycles_per_byte", res.cyclesPerByte);
+        if (res.cyclesSamples.size() <= MaxSavedSamples) {
+            //samples are needed for comparison with baseline
+            fprintf(f, ", \"cycles_samples\": [");
+            for (size_t j = 0; j < res.cyclesSamples.size(); j++)
+                fprintf(f, "%s%0.6lf", (j ? ", " : ""), res.cyclesSamples[j]);
+            fprintf(f, "]");
+        }
+        fprintf(f, ", ");
+        WriteSummaryJson(f, "gb_per_sec", res.gigabytesPerSec);
+        if (!res.note.empty())
+            fprintf(f, ", \"note\": \"%s\"", EscapeJsonString(res.note).c_str());
+        if (!res.percentiles.empty()) {
+            fprintf(f, ", \"cycles_per_call\": {");
+            for (int q = 0; q < LatencyQuantilesCount; q++)
+                fprintf(f, "%s\"%s\": %0.1lf", (q ? ", " : ""), LatencyQuantiles[q].name, res.percentiles[q]);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+//======================================= Baseline comparison =====================================
+
+//searches for "key": in given line of JSON (starting from position 'from')
+//returns position right after the colon, or npos
+size_t FindJsonKey(const std::string &line, const char *key, size_t from = 0) {
+    size_t pos = line.find(std::string("\"") + key + "\":", from);
+    return pos == std::string::npos ? pos : pos + strlen(key) + 3;
+}
+//reads string value, undoing escaping done by EscapeJsonString
+bool ReadJsonString(const std::string &line, const char *key, std::string &value) {
+    size_t pos = FindJsonKey(line, key);
+    if (pos == std::string::npos || (pos = line.find('"', pos)) == std::string::npos)
+        return false;
+    value.clear();
+    for (size_t i = pos + 1; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '"')
+            return true;
+        if (c == '\\') {
+            if (++i == line.size())
+                return false;
+            c = line[i];
+            if (c == 'u') {
+                unsigned code;
+                if (i + 4 >= line.size() || sscanf(line.c_str() + i + 1, "%4x", &code) != 1)
+                    return false;
+                c = char(code);
+                i += 4;
+            }
+        }
+        value += c;
+    }
+    return false;
+}
+bool ReadJsonNumber(const std::string &line, const char *key, double &value, size_t from = 0) {
+    size_t pos = FindJsonKey(line, key, from);
+    return pos != std::string::npos && sscanf(line.c_str() + pos, "%lf", &value) == 1;
+}
+
+//reads results from JSON file written by WriteResultsJson (one result per line)
+//only the fields needed for comparison are read
+bool ReadResultsJson(const char *path, std::vector<BenchResult> &results, std::string &cpu) {
+    FILE *f = fopen(path, "rt");
+    if (!f)
+        return false;
+    std::string content;
+    char chunk[1<<16];
+    while (size_t cnt = fread(chunk, 1, sizeof(chunk), f))
+        content.append(chunk, cnt);
+    fclose(f);
+
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == std::string::npos)
+            end = content.size();
+        std::string line = content.substr(pos, end - pos);
+        pos = end + 1;
+        if (FindJsonKey(line, "machine") != std::string::npos)
+            ReadJsonString(line, "cpu", cpu);
+        if (FindJsonKey(line, "suite") == std::string::npos)
+            continue;
+        BenchResult res;
+        double size;
+        size_t cyclesPos = FindJsonKey(line, "cycles_per_byte");
+        if (!ReadJsonString(line, "suite", res.suite) || !ReadJsonString(line, "name", res.name) ||
+            !ReadJsonString(line, "distribution", res.distribution) || !ReadJsonNumber(line, "size", size) ||
+            cyclesPos == std::string::npos || !ReadJsonNumber(line, "median", res.cyclesPerByte.median, cyclesPos) ||
+            !ReadJsonNumber(line, "mad", res.cyclesPerByte.mad, cyclesPos)
+        ) {
+            return false;
+        }
+        res.size = (long long)size;
+        size_t samplesPos = FindJsonKey(line, "cycles_samples");
+        if (samplesPos != std::string::npos && (samplesPos = line.find('[', samplesPos)) != std::string::npos) {
+            const char *ptr = line.c_str() + samplesPos + 1;
+            char *next;
+            double value;
+            while ((value = strtod(ptr, &next)), next != ptr) {
+                res.cyclesSamples.push_back(value);
+                ptr = next;
+                while (*ptr == ',' || *ptr == ' ')
+                    ptr++;
+            }
+        }
+        results.push_back(res);
+    }
+    return true;
+}
+
+//95% confidence interval of ratio current / baseline of median cycles per byte
+//if samples are known on both sides, then bootstrap is used (resampling with replacement),
+//otherwise the interval is estimated from median absolute deviation (assuming normal distribution)
+void GetRatioInterval(const BenchResult &base, const BenchResult &curr, double &low, double &high) {
+    static const int Resamples = 2000;
+    if (base.cyclesSamples.size() >= 3 && curr.cyclesSamples.size() >= 3) {
+        std::mt19937 rnd(13);
+        std::vector<double> ratios, a, b;
+        for (int r = 0; r < Resamples; r++) {
+            a.clear();
+            b.clear();
+            for (size_t i = 0; i < base.cyclesSamples.size(); i++)
+                a.push_back(base.cyclesSamples[rnd() % base.cyclesSamples.size()]);
+            for (size_t i = 0; i < curr.cyclesSamples.size(); i++)
+                b.push_back(curr.cyclesSamples[rnd() % curr.cyclesSamples.size()]);
+            ratios.push_back(Summarize(b).median / DMAX(Summarize(a).median, 1e-9));
+        }
+        std::sort(ratios.begin(), ratios.end());
+        low = ratios[Resamples * 25 / 1000];
+        high = ratios[Resamples * 975 / 1000 - 1];
+        return;
+    }
+    //standard error of median = 1.2533 * sigma / sqrt(n), sigma = 1.4826 * MAD
+    size_t nb = DMAX(base.cyclesSamples.size(), size_t(1)), nc = DMAX(curr.cyclesSamples.size(), size_t(1));
+    double errBase = 1.96 * 1.2533 * 1.4826 * base.cyclesPerByte.mad / sqrt(double(nb));
+    double errCurr = 1.96 * 1.2533 * 1.4826 * curr.cyclesPerByte.mad / sqrt(double(nc));
+    low = (curr.cyclesPerByte.median - errCurr) / DMAX(base.cyclesPerByte.median + errBase, 1e-9);
+    high = (curr.cyclesPerByte.median + errCurr) / DMAX(base.cyclesPerByte.median - errBase, 1e-9);
+}
+
+//prints comparison of every result with the same benchmark in baseline
+//benchmark fails if it is slower than baseline by more than threshold with 95% confidence
+//returns false if any benchmark fails
+bool CompareWithBaseline(const std::vector<BenchResult> &baseline, const std::string &baselineCpu) {
+    printf("\nComparison with baseline %s (threshold %0.1lf%%, 95%% confidence):\n", cfg.baselinePath, cfg.threshold);
+    if (baselineCpu != GetCpuName())
+        printf("Warning: baseline was measured on different CPU: %s\n", baselineCpu.c_str());
+    int passed = 0, faster = 0, failed = 0, added = 0;
+    double limit = 1.0 + cfg.threshold * 0.01;
+    for (size_t i = 0; i < allResults.size(); i++) {
+        const BenchResult &curr = allResults[i];
+        std::string fullName = GetFullName(curr.suite.c_str(), curr.name, curr.distribution.c_str(), curr.size);
+        const BenchResult *base = 0;
+        for (size_t j = 0; j < baseline.size() && !base; j++)
+            if (GetFullName(baseline[j].suite.c_str(), baseline[j].name, baseline[j].distribution.c_str(), baseline[j].size) == fullName)
+                base = &baseline[j];
+        if (!base) {
+            printf("  NEW     %-60s %7.3f cyc/B\n", fullName.c_str(), curr.cyclesPerByte.median);
+            added++;
+            continue;
+        }
+        double low, high;
+        GetRatioInterval(*base, curr, low, high);
+        const char *verdict = "PASS";
+        if (low > limit) {
+            verdict = "FAIL";
+            failed++;
+        }
+        else if (high < 1.0 / limit) {
+            verdict = "FASTER";
+            faster++;
+            passed++;
+        }
+        else
+            passed++;
+        double change = curr.cyclesPerByte.median / DMAX(base->cyclesPerByte.median, 1e-9) - 1.0;
+        printf("  %-7s %-60s %7.3f -> %7.3f cyc/B  %+6.1f%% [%+6.1f%%, %+6.1f%%]\n", verdict, fullName.c_str(),
+            base->cyclesPerByte.median, curr.cyclesPerByte.median, 100.0 * change, 100.0 * (low - 1.0), 100.0 * (high - 1.0)
+        );
+    }
+    printf("Passed: %d (faster: %d), failed: %d, not in baseline: %d\n", passed, faster, failed, added);
+    printf("Verdict: %s\n", (failed ? "FAIL" : "PASS"));
+    return failed == 0;
+}
+
+//============================================== Main =============================================
+
+int ParseSuites(const char *list) {
+    int res = 0;
+    std::string s = list;
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string token = s.substr(pos, end - pos);
+        if (token == "core") res |= stCore;
+        else if (token == "processor") res |= stProcessor;
+        else if (token == "message") res |= stMessage;
+        else if (token == "sweep") res |= stSweep;
+        else if (token == "thrash") res |= stThrash;
+        else if (token == "latency") res |= stLatency;
+        else if (token == "scaling") res |= stScaling;
+        else if (token == "compare") res |= stCompare;
+        else if (token == "files") res |= stFiles;
+        else if (token == "roofline") res |= stRoofline;
+        else if (token == "fileio") res |= stFileIO;
+        else if (token == "all") res |= stAll;
+        else PrintHelp();
+        pos = end + 1;
+    }
+    return res;
+}
+
+std::vector<long long> ParseSizes(const char *list) {
+    std::vector<long long> res;
+    const char *ptr = list;
+    while (*ptr) {
+        char *end;
+        long long value = strtoll(ptr, &end, 10);
+        if (end == ptr || value <= 0)
+            PrintHelp();
+        res.push_back(value);
+        ptr = (*end == ',' ? end + 1 : end);
+    }
+    return res;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int num;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+            PrintHelp();
+        else if (strncmp(arg, "--suite=", 8) == 0)
+            cfg.suites = ParseSuites(arg + 8);
+        else if (strncmp(arg, "--filter=", 9) == 0)
+            cfg.filter = arg + 9;
+        else if (strncmp(arg, "--sizes=", 8) == 0) {
+            cfg.sizes = ParseSizes(arg + 8);
+            cfg.sizesGiven = true;
+        }
+        else if (sscanf(arg, "-r=%d", &num) == 1 && num > 0)
+            cfg.repetitions = num;
+        else if (sscanf(arg, "--warmup=%d", &num) == 1 && num >= 0)
+            cfg.warmupRuns = num;
+        else if (sscanf(arg, "--minbytes=%d", &num) == 1 && num > 0)
+            cfg.minBytesPerSample = num;
+        else if (strncmp(arg, "--json=", 7) == 0)
+            cfg.jsonPath = arg + 7;
+        else if (strncmp(arg, "--dists=", 8) == 0)
+            cfg.distributions = arg + 8;
+        else if (sscanf(arg, "--sweepmax=%lld", &cfg.sweepMaxSize) == 1 && cfg.sweepMaxSize >= 256)
+            ;
+        else if (sscanf(arg, "--thrashsize=%lld", &cfg.thrashSize) == 1 && cfg.thrashSize > 0)
+            ;
+        else if (sscanf(arg, "--samples=%d", &num) == 1 && num > 0)
+            cfg.latencySamples = num;
+        else if (strncmp(arg, "--threads=", 10) == 0)
+            cfg.threads = ParseSizes(arg + 10);
+        else if (sscanf(arg, "--threadsize=%lld", &cfg.threadSize) == 1 && cfg.threadSize >= 4096)
+            ;
+        else if (strncmp(arg, "--files=", 8) == 0)
+            cfg.files = arg + 8;
+        else if (strncmp(arg, "--baseline=", 11) == 0)
+            cfg.baselinePath = arg + 11;
+        else if (sscanf(arg, "--threshold=%lf", &cfg.threshold) == 1 && cfg.threshold >= 0.0)
+            ;
+        else
+            PrintHelp();
+    }
+
+    printf("CPU: %s\n", GetCpuName().c_str());
+    printf("Warmup runs: %d, repetitions: %d (median and MAD are reported)\n\n", cfg.warmupRuns, cfg.repetitions);
+    if (cfg.suites & stCore)
+        RunCoreSuite();
+    if (cfg.suites & stProcessor)
+        RunProcessorSuite();
+    if (cfg.suites & stMessage)
+        RunMessageSuite();
+    if (cfg.suites & stSweep)
+        RunSweepSuite();
+    if (cfg.suites & stThrash)
+        RunThrashSuite();
+    if (cfg.suites & stLatency)
+        RunLatencySuite();
+    if (cfg.suites & stScaling)
+        RunScalingSuite();
+    if (cfg.suites & stCompare)
+        RunCompareSuite();
+    if (cfg.suites & stFiles)
+        RunFilesSuite();
+    if (cfg.suites & stRoofline)
+        RunRooflineSuite();
+    if (cfg.suites & stFileIO)
+        RunFileIOSuite();
+
+    if (cfg.jsonPath) {
+        if (!WriteResultsJson(cfg.jsonPath)) {
+            printf("Cannot write file: %s\n", cfg.jsonPath);
+            return 1;
+        }
+        printf("\nSaved %d results to %s\n", int(allResults.size()), cfg.jsonPath);
+    }
+    if (cfg.baselinePath) {
+        std::vector<BenchResult> baseline;
+        std::string baselineCpu;
+        if (!ReadResultsJson(cfg.baselinePath, baseline, baselineCpu)) {
+            printf("Cannot read baseline file: %s\n", cfg.baselinePath);
+            return 1;
+        }
+        if (!CompareWithBaseline(baseline, baselineCpu))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "tests/CorpusGenerator.h"
+#include "buffer/ProcessorSelector.h"
+#include <string.h>
+#include <stdint.h>
+#include <random>
+
+static const int MaxRanges = 6;
+static const int MaxStates = 4;
+
+struct CodeRange {
+    int first, last;    //inclusive range of code points
+    double weight;      //probability of choosing this range (relative)
+};
+
+struct ScriptState {
+    const char *name;
+    CodeRange ranges[MaxRanges];    //terminated with zero weight
+    double meanRun;                 //mean number of code points in one run (geometric distribution)
+    bool asciiText;                 //mean run is overridden by CorpusSettings::asciiRunMean
+    double next[MaxStates];         //weights of transitions to other states after the run
+};
+
+struct ProfileModel {
+    const char *name;
+    ScriptState states[MaxStates];  //terminated with null name, the first state is initial
+};
+
+//note: the numbers are rough estimates of typical texts, not exact statistics
+static const ProfileModel Profiles[cpCount] = {
+    {"english", {
+        {"text", {{'a', 'z', 78}, {'A', 'Z', 3}, {' ', ' ', 17}, {',', '.', 2}}, 300.0, true, {0, 1, 4, 0}},
+        {"latin1", {{0xE0, 0xFF, 10}, {0xC0, 0xDF, 1}}, 1.0, false, {1, 0, 0, 0}},
+        {"typography", {{0x2018, 0x201D, 8}, {0x2013, 0x2014, 3}, {0x2026, 0x2026, 1}}, 1.0, false, {1, 0, 0, 0}},
+    }},
+    {"russian", {
+        {"cyrillic", {{0x430, 0x44F, 95}, {0x410, 0x42F, 4}, {0x451, 0x451, 1}}, 6.0, false, {0, 90, 1, 3}},
+        {"spaces", {{' ', ' ', 85}, {',', '.', 10}, {'!', '!', 1}, {'?', '?', 1}, {'\n', '\n', 3}}, 1.3, false, {92, 0, 4, 4}},
+        {"latin", {{'a', 'z', 6}, {'0', '9', 4}}, 5.0, true, {0, 1, 0, 0}},
+        {"typography", {{0xAB, 0xAB, 2}, {0xBB, 0xBB, 2}, {0x2014, 0x2014, 3}, {0x2026, 0x2026, 1}}, 1.0, false, {1, 1, 0, 0}},
+    }},
+    {"chinese", {
+        {"han", {{0x4E00, 0x9FA5, 1}}, 12.0, false, {0, 90, 8, 0.5}},
+        {"punctuation", {{0x3001, 0x3002, 6}, {0xFF0C, 0xFF0C, 8}, {0xFF1A, 0xFF1B, 1}, {0x300C, 0x300D, 2}}, 1.0, false, {95, 0, 5, 0}},
+        {"ascii", {{'0', '9', 4}, {'a', 'z', 4}, {'A', 'Z', 1}, {' ', ' ', 2}}, 4.0, true, {1, 0, 0, 0}},
+        {"han-ext", {{0x20000, 0x2A6DF, 1}}, 1.0, false, {1, 0, 0, 0}},
+    }},
+    {"emoji", {
+        {"text", {{'a', 'z', 75}, {' ', ' ', 18}, {'!', '!', 2}, {',', '.', 3}, {'\n', '\n', 2}}, 30.0, true, {0, 8, 0, 1}},
+        {"emoji", {{0x1F600, 0x1F64F, 6}, {0x1F300, 0x1F5FF, 3}, {0x1F900, 0x1F9FF, 2}}, 1.8, false, {6, 0, 3, 0}},
+        {"joiners", {{0xFE0F, 0xFE0F, 3}, {0x200D, 0x200D, 1}}, 1.0, false, {2, 1, 0, 0}},
+        {"symbols", {{0x2600, 0x26FF, 3}, {0x2764, 0x2764, 1}}, 1.0, false, {1, 0, 1, 0}},
+    }},
+    {"json", {
+        {"syntax", {{'a', 'z', 40}, {'"', '"', 10}, {':', ':', 4}, {',', ',', 4}, {'0', '9', 20}, {' ', ' ', 8}}, 40.0, true, {0, 5, 2, 1}},
+        {"cyrillic", {{0x430, 0x44F, 95}, {0x410, 0x42F, 5}}, 6.0, false, {1, 0, 0, 0}},
+        {"han", {{0x4E00, 0x9FA5, 1}}, 5.0, false, {1, 0, 0, 0}},
+        {"latin1", {{0xE0, 0xFF, 1}}, 1.0, false, {1, 0, 0, 0}},
+    }},
+    {"html", {
+        {"markup", {{'a', 'z', 60}, {'<', '>', 12}, {'/', '/', 4}, {'"', '"', 4}, {' ', ' ', 15}, {'\n', '\n', 2}}, 80.0, true, {0, 1, 0, 0}},
+        {"cyrillic", {{0x430, 0x44F, 95}, {0x410, 0x42F, 5}}, 6.0, false, {10, 0, 85, 5}},
+        {"spaces", {{' ', ' ', 90}, {',', '.', 10}}, 1.3, false, {15, 85, 0, 0}},
+        {"typography", {{0xA0, 0xA0, 3}, {0xAB, 0xAB, 1}, {0xBB, 0xBB, 1}, {0x2014, 0x2014, 1}}, 1.0, false, {0, 1, 0, 0}},
+    }},
+};
+
+const char *GetCorpusProfileName(int profile) {
+    return profile >= 0 && profile < cpCount ? Profiles[profile].name : 0;
+}
+
+int GetCorpusProfileByName(const char *name) {
+    for (int p = 0; p < cpCount; p++)
+        if (strcmp(Profiles[p].name, name) == 0)
+            return p;
+    return -1;
+}
+
+static int GetUtf8Length(int code) {
+    return code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4;
+}
+
+int GetCorpusMaxLength(int profile) {
+    int res = 0;
+    const ProfileModel &model = Profiles[profile];
+    for (int s = 0; s < MaxStates && model.states[s].name; s++)
+        for (int r = 0; r < MaxRanges && model.states[s].ranges[r].weight > 0; r++)
+            if (res < GetUtf8Length(model.states[s].ranges[r].last))
+                res = GetUtf8Length(model.states[s].ranges[r].last);
+    return res;
+}
+
+int WriteCodePoint(int code, int format, char *dst) {
+    unsigned char *d = (unsigned char *)dst;
+    if (format == dfUtf32) {
+        uint32_t unit = code;
+        memcpy(d, &unit, 4);
+        return 4;
+    }
+    if (format == dfUtf16) {
+        uint16_t units[2];
+        int cnt = 1;
+        if (code < 0x10000)
+            units[0] = uint16_t(code);
+        else {
+            units[0] = uint16_t(0xD800 + ((code - 0x10000) >> 10));
+            units[1] = uint16_t(0xDC00 + ((code - 0x10000) & 0x3FF));
+            cnt = 2;
+        }
+        memcpy(d, units, 2 * cnt);
+        return 2 * cnt;
+    }
+    if (code < 0x80) {
+        d[0] = code;
+        return 1;
+    }
+    if (code < 0x800) {
+        d[0] = 0xC0 | (code >> 6);
+        d[1] = 0x80 | (code & 63);
+        return 2;
+    }
+    if (code < 0x10000) {
+        d[0] = 0xE0 | (code >> 12);
+        d[1] = 0x80 | ((code >> 6) & 63);
+        d[2] = 0x80 | (code & 63);
+        return 3;
+    }
+    d[0] = 0xF0 | (code >> 18);
+    d[1] = 0x80 | ((code >> 12) & 63);
+    d[2] = 0x80 | ((code >> 6) & 63);
+    d[3] = 0x80 | (code & 63);
+    return 4;
+}
+
+//chooses index with probability proportional to its weight
+template<class Rnd> static int ChooseWeighted(Rnd &rnd, const double *weights, int count) {
+    double total = 0.0;
+    for (int i = 0; i < count; i++)
+        total += weights[i];
+    double value = std::uniform_real_distribution<double>(0.0, total)(rnd);
+    for (int i = 0; i < count; i++) {
+        value -= weights[i];
+        if (value < 0.0 && weights[i] > 0.0)
+            return i;
+    }
+    //rounding errors: return the last index with positive weight
+    for (int i = count - 1; i > 0; i--)
+        if (weights[i] > 0.0)
+            return i;
+    return 0;
+}
+
+void GenerateCorpus(std::vector<char> &result, const CorpusSettings &settings, int format, long long maxBytes, long long maxCodePoints, unsigned seed, std::vector<int> *boundaries) {
+    const ProfileModel &model = Profiles[settings.profile];
+    int statesCount = 0;
+    while (statesCount < MaxStates && model.states[statesCount].name)
+        statesCount++;
+
+    std::mt19937 rnd(seed);
+    result.clear();
+    if (boundaries)
+        boundaries->clear();
+    long long codePoints = 0;
+    int state = 0;
+    while (true) {
+        const ScriptState &st = model.states[state];
+        double meanRun = (st.asciiText && settings.asciiRunMean > 0.0 ? settings.asciiRunMean : st.meanRun);
+        //geometric distribution starting from 1 with given mean
+        long long runLength = 1;
+        if (meanRun > 1.0)
+            runLength += std::geometric_distribution<int>(1.0 / meanRun)(rnd);
+
+        int rangesCount = 0;
+        double rangeWeights[MaxRanges];
+        while (rangesCount < MaxRanges && st.ranges[rangesCount].weight > 0.0) {
+            rangeWeights[rangesCount] = st.ranges[rangesCount].weight;
+            rangesCount++;
+        }
+        for (long long i = 0; i < runLength; i++) {
+            const CodeRange &range = st.ranges[ChooseWeighted(rnd, rangeWeights, rangesCount)];
+            int code = range.first + int(rnd() % unsigned(range.last - range.first + 1));
+            char buff[4];
+            int bytes = WriteCodePoint(code, format, buff);
+            if ((long long)result.size() + bytes > maxBytes || codePoints >= maxCodePoints)
+                return;
+            if (boundaries)
+                boundaries->push_back(int(result.size()));
+            result.insert(result.end(), buff, buff + bytes);
+            codePoints++;
+        }
+
+        state = ChooseWeighted(rnd, st.next, statesCount);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+// Generator of synthetic text which resembles real data of some kind.
+// Uniformly random code points (like [rnd1110:%d] in FileConverter) are the worst case for the fast path:
+// real text consists of runs of code points from one script block, e.g. words of cyrillic letters separated by ASCII spaces.
+// Here every profile is a Markov chain over script blocks: each state emits a run of code points from its block
+// (geometric distribution of run length), then jumps to another state according to transition probabilities.
+// Since every script block has fixed length of code points in UTF-8, it is also a chain over length classes.
+enum CorpusProfile {
+    cpEnglish,      // long ASCII runs, rare latin-1 letters and typographic quotes
+    cpRussian,      // cyrillic words (2 bytes) separated by ASCII spaces and punctuation
+    cpChinese,      // long runs of CJK ideographs (3 bytes), CJK punctuation, rare ASCII and 4-byte ideographs
+    cpEmoji,        // chat messages: ASCII text mixed with emoji (4 bytes) and variation selectors
+    cpJson,         // ASCII syntax and numbers, string values in various languages
+    cpHtml,         // ASCII markup with cyrillic text between tags
+    cpCount         //(helper)
+};
+
+struct CorpusSettings {
+    int profile;            // from CorpusProfile enum
+    double asciiRunMean;    // mean length of long ASCII runs (text, markup), zero means default of the profile
+
+    CorpusSettings(int profile = cpEnglish, double asciiRunMean = 0.0) : profile(profile), asciiRunMean(asciiRunMean) {}
+};
+
+// Returns name of profile (e.g. "russian"), or null for invalid profile.
+const char *GetCorpusProfileName(int profile);
+// Returns profile with given name, or -1 if there is no such profile.
+int GetCorpusProfileByName(const char *name);
+// Returns max length (in UTF-8 bytes) of code points which can be generated with given profile.
+int GetCorpusMaxLength(int profile);
+
+// Generates text in given format (dfUtf8, dfUtf16, or dfUtf32) and stores it into 'result'.
+// Generation stops before exceeding either 'maxBytes' bytes or 'maxCodePoints' code points.
+// If 'boundaries' is not null, then offsets of all generated code points are saved there.
+// The same seed always produces the same text.
+void GenerateCorpus(std::vector<char> &result, const CorpusSettings &settings, int format, long long maxBytes, long long maxCodePoints, unsigned seed, std::vector<int> *boundaries = 0);
+
+// Writes code point in given format, returns number of bytes written (at most 4).
+int WriteCodePoint(int code, int format, char *dst);
@@ -9,468 +9,13 @@
 #include <algorithm>
 
 #include "message/MessageConverter.h"
+#include "message/InlineConverter.h"
 #include "buffer/ProcessorSelector.h"
+#include "base/Allocator.h"
+#include "base/Crc32c.h"
+#include "tests/TestsGenerator.h"
 
 
-#define RND std::mt19937
-
-typedef std::vector<uint8_t> Data;
-
-//simple string operations
-Data operator+ (const Data &a, const Data &b) {
-    Data res = a;
-    res.insert(res.end(), b.begin(), b.end());
-    return res;
-}
-Data Substr(const Data &data, int start, int end = -1) {
-    if (end < 0) end = data.size();
-    start = std::max(std::min(start, (int)data.size()), 0);
-    end = std::max(std::min(end, (int)data.size()), start);
-    return Data(data.begin() + start, data.begin() + end);
-}
-Data Reverse(const Data &data) {
-    Data res = data;
-    std::reverse(res.begin(), res.end());
-    return res;
-}
-
-class SimpleConverter {
-protected:
-    DataFormat format;  
-
-public:
-    static const int MaxCode = 0x10FFFF;
-    static const int MaxBytes = 4;
-    static int MaxCodeOfSize(int bytes) {
-        if (bytes == 0) return -1;
-        if (bytes == 1) return 0x0000007F;
-        if (bytes == 2) return 0x000007FF;
-        if (bytes == 3) return 0x0000FFFF;
-        if (bytes == 4) return MaxCode;
-        assert(0); return 0;
-    }
-
-    static bool IsCodeValid(int code) {
-        return code >= 0 && code <= MaxCode && !(code >= 0xD800U && code < 0xE000U);
-    }
-
-    SimpleConverter(DataFormat format) : format(format) {}
-
-    static void WriteWord8(Data &data, uint8_t word) {
-        data.push_back(word & 0xFFU);
-    }
-    static void WriteWord16(Data &data, uint16_t word) {
-        data.push_back(word & 0xFFU); word >>= 8;
-        data.push_back(word & 0xFFU);
-    }
-    static void WriteWord32(Data &data, uint32_t word) {
-        data.push_back(word & 0xFFU); word >>= 8;
-        data.push_back(word & 0xFFU); word >>= 8;
-        data.push_back(word & 0xFFU); word >>= 8;
-        data.push_back(word & 0xFFU);
-    }
-
-    void AddChar(Data &data, int code, int utf8len = -1) const {
-        //assert(IsCodeValid(code));
-        if (format == dfUtf32) {
-            WriteWord32(data, uint32_t(code));
-        }
-        else if (format == dfUtf16) {
-            //from https://ru.wikipedia.org/wiki/UTF-16#.D0.9A.D0.BE.D0.B4.D0.B8.D1.80.D0.BE.D0.B2.D0.B0.D0.BD.D0.B8.D0.B5
-            if (code < 0x10000)
-                WriteWord16(data, uint16_t(code));
-            else {
-                code = code - 0x10000;
-                int lo10 = (code & 0x03FF);
-                int hi10 = (code >> 10);
-                WriteWord16(data, uint16_t(0xD800 | hi10));
-                WriteWord16(data, uint16_t(0xDC00 | lo10));
-            }
-        }
-        else if (format == dfUtf8) {
-            //from http://stackoverflow.com/a/6240184/556899
-            if (code <= 0x0000007F && utf8len <= 1)             //0xxxxxxx
-                WriteWord8(data, uint8_t(0x00 | ((code >>  0) & 0x7F)));
-            else if (code <= 0x000007FF && utf8len <= 2) {      //110xxxxx 10xxxxxx
-                WriteWord8(data, uint8_t(0xC0 | ((code >>  6) & 0x1F)));
-                WriteWord8(data, uint8_t(0x80 | ((code >>  0) & 0x3F)));
-            }
-            else if (code <= 0x0000FFFF && utf8len <= 3) {      //1110xxxx 10xxxxxx 10xxxxxx
-                WriteWord8(data, uint8_t(0xE0 | ((code >> 12) & 0x0F)));
-                WriteWord8(data, uint8_t(0x80 | ((code >>  6) & 0x3F)));
-                WriteWord8(data, uint8_t(0x80 | ((code >>  0) & 0x3F)));
-            }
-            else {                                              //11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-                WriteWord8(data, uint8_t(0xF0 | ((code >> 18) & 0x07)));
-                WriteWord8(data, uint8_t(0x80 | ((code >> 12) & 0x3F)));
-                WriteWord8(data, uint8_t(0x80 | ((code >>  6) & 0x3F)));
-                WriteWord8(data, uint8_t(0x80 | ((code >>  0) & 0x3F)));
-            }
-        }
-        else assert(0);
-    }
-
-    static int ParseWord8(const Data &data, const uint8_t *&ptr) {
-        if (ptr + 1 > data.data() + data.size())
-            throw std::runtime_error("Cannot read a byte");
-        uint32_t a = (*ptr++);
-        return a;
-    }
-    static int ParseWord16(const Data &data, const uint8_t *&ptr) {
-        if (ptr + 2 > data.data() + data.size())
-            throw std::runtime_error("Cannot read a 16-bit word");
-        uint32_t a = (*ptr++);
-        uint32_t b = (*ptr++);
-        return a + (b << 8);
-    }
-    static int ParseWord32(const Data &data, const uint8_t *&ptr) {
-        if (ptr + 4 > data.data() + data.size())
-            throw std::runtime_error("Cannot read a 32-bit word");
-        uint32_t a = (*ptr++);
-        uint32_t b = (*ptr++);
-        uint32_t c = (*ptr++);
-        uint32_t d = (*ptr++);
-        return a + (b << 8) + (c << 16) + (d << 24);
-    }
-
-    int ParseChar(const Data &data, const uint8_t *&uptr) const {
-        const uint8_t *ptr = uptr;
-        uint32_t code = (uint32_t)-1;
-
-        if (format == dfUtf32) {
-            code = ParseWord32(data, ptr);
-        }
-        else if (format == dfUtf16) {
-            code = ParseWord16(data, ptr);
-            if (code >= 0xD800U && code < 0xDC00U) {
-                uint32_t rem = ParseWord16(data, ptr);
-                if (!(rem >= 0xDC00U && rem < 0xE000U))
-                    throw std::runtime_error("Second part of surrogate pair is out of range");
-                code = ((code - 0xD800U) << 10) + (rem - 0xDC00U) + 0x010000;
-            }
-        }
-        else if (format == dfUtf8) {
-            code = ParseWord8(data, ptr);
-            int cnt;
-            if ((code & 0x80U) == 0x00U)            //0xxxxxxx
-                cnt = 0;
-            else if ((code & 0xE0U) == 0xC0U) {     //110xxxxx 10xxxxxx
-                cnt = 1;
-                code -= 0xC0U;
-            }
-            else if ((code & 0xF0U) == 0xE0U) {     //1110xxxx 10xxxxxx 10xxxxxx
-                cnt = 2;
-                code -= 0xE0U;
-            }
-            else if ((code & 0xF8U) == 0xF0U) {     //11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-                cnt = 3;
-                code -= 0xF0U;
-            }
-            else
-                throw std::runtime_error("Failed to parse leading byte");
-
-            for (int t = 0; t < cnt; t++) {
-                uint32_t add = ParseWord8(data, ptr);
-                if ((add & 0xC0U) != 0x80U)
-                    throw std::runtime_error("Continuation byte out of range");
-                code = (code << 6) + (add - 0x80U);
-            }
-            if (int(code) <= MaxCodeOfSize(cnt))
-                throw std::runtime_error("Overlong encoding");
-        }
-        else assert(0);
-
-        if (!IsCodeValid(code))
-            throw std::runtime_error("Parsed invalid code point");
-
-        uptr = ptr;
-        return code;
-    }
-
-    Data ByteToData(uint8_t byte) const {
-        return Data(1, byte);
-    }
-    Data CodeToData(int code) const {
-        Data res;
-        AddChar(res, code);
-        return res;
-    }
-    template<typename BytesContainer>
-    Data BytesToData(BytesContainer bytes) {
-        Data res;
-        for (auto it = std::begin(bytes); it != std::end(bytes); it++) {
-            uint8_t byte = *it;
-            res.push_back(byte);
-        }
-        return res;
-    }
-    template<typename CodesContainer>
-    Data CodesToData(CodesContainer codes) {
-        Data res;
-        for (auto it = std::begin(codes); it != std::end(codes); it++) {
-            int code = *it;
-            AddChar(res, code);
-        }
-        return res;
-    }
-
-    std::vector<int> ParseCodes(const Data &data) {
-        const uint8_t *ptr = data.data();
-        std::vector<int> res;
-        while (ptr < data.data() + data.size()) {
-            int code = ParseChar(data, ptr);
-            res.push_back(code);
-        }
-        return res;
-    }
-
-    //always finds a split at range [pos .. pos+3]
-    //if input is correct, then split is surely between two chars
-    //if input is invalid, then any split can be returned
-    int FindSplit(const Data &data, int pos) const {
-        pos = std::max(std::min(pos, (int)data.size()), 0);
-        if (format == dfUtf32) {
-            //align with 32-bit words
-            while (pos & 3) pos++;
-        }
-        else if (format == dfUtf16) {
-            //align with 16-bit words
-            while (pos & 1) pos++;
-            //check if in the middle of surrogate pair
-            if (pos + 1 < data.size()) {
-                uint16_t val = data[pos] + (data[pos+1] << 8);
-                if (val >= 0xDC00U && val < 0xE000U)
-                    pos += 2;   //move past surrogate's second half
-            }
-        }
-        else if (format == dfUtf8) {
-            //move past continuation bytes (at most 3 of them)
-            for (int i = 0; i < 3; i++)
-                if (pos < data.size() && data[pos] >= 0x80U && data[pos] < 0xC0U)
-                    pos++;
-        }
-        pos = std::min(pos, int(data.size()));
-        return pos;
-    }
-};
-
-
-class BaseGenerator : public SimpleConverter {
-protected:
-    RND &rnd;
-
-    typedef std::uniform_int_distribution<int> Distrib;
-
-public:
-    BaseGenerator(DataFormat format, RND &rnd) : SimpleConverter(format), rnd(rnd) {}
-
-//=============== Data generation ==================
-
-    uint8_t RandomByte() {
-        uint8_t byte = Distrib(0, 255)(rnd);
-        return byte;
-    }
-    int RandomCode(int mask = 0) {
-        if (mask == 0) mask = (1 << MaxBytes) - 1;
-        assert(mask > 0 && mask < (1 << MaxBytes));
-
-        int bytes;
-        do {
-            bytes = Distrib(1, MaxBytes)(rnd);
-        } while (!(mask & (1 << (bytes-1))));
-
-        int minCode = MaxCodeOfSize(bytes - 1) + 1;
-        int maxCode = MaxCodeOfSize(bytes);
-        int code;
-        do {
-            code = Distrib(minCode, maxCode)(rnd);
-        } while (code >= 0xD800U && code < 0xE000U);
-
-        return code;
-    }
-    std::vector<uint8_t> RandomBytes(int size) {
-        std::vector<uint8_t> res;
-        for (int i = 0; i < size; i++)
-            res.push_back(RandomByte());
-        return res;
-    }
-    std::vector<int> RandomCodes(int size, int mask = 0) {
-        std::vector<int> res;
-        for (int i = 0; i < size; i++)
-            res.push_back(RandomCode(mask));
-        return res;
-    }
-
-    int RandomPos(const Data &data) {
-        int pos = Distrib(0, int(data.size()))(rnd);
-        return pos;
-    }
-    int RandomSplit(const Data &data) {
-        int pos = RandomPos(data);
-        pos = FindSplit(data, pos);
-        return pos;
-    }
-};
-
-
-class TestsGenerator : public BaseGenerator {
-    int mutRad;
-
-public:
-    TestsGenerator (DataFormat format, RND &rnd) : BaseGenerator(format, rnd) {
-        SetMutationRadius();
-    }
-
-    //how close mutations are to each other (if there are several of them)
-    void SetMutationRadius(int rad = 10) {
-        mutRad = rad;
-    }
-
-    int PosByHint(const Data &data, int hint = -1) {
-        if (hint < 0)
-            hint = RandomPos(data);
-        hint += Distrib(-mutRad, mutRad)(rnd);
-        return hint;
-    }
-
-//============ Mutations of single data ===============
-
-    int MutateDoubleBytes(Data &data, int hint = -1) {
-        int pos = PosByHint(data, hint);
-        int next = pos + Distrib(1, mutRad)(rnd);
-        data = Substr(data, 0, pos) + Substr(data, pos, next) + Substr(data, pos, next) + Substr(data, next);
-        return next;
-    }
-    int MutateDoubleChars(Data &data, int hint = -1) {
-        int pos = FindSplit(data, PosByHint(data, hint));
-        int next = FindSplit(data, pos + Distrib(1, mutRad)(rnd));
-        data = Substr(data, 0, pos) + Substr(data, pos, next) + Substr(data, pos, next) + Substr(data, next);
-        return next;
-    }
-
-    int MutateAddRandomBytes(Data &data, int hint = -1) {
-        int pos = PosByHint(data, hint);
-        data = Substr(data, 0, pos) + BytesToData(RandomBytes(Distrib(1, mutRad)(rnd))) + Substr(data, pos);
-        return pos;
-    }
-    int MutateAddRandomChar(Data &data, int hint = -1) {
-        int pos = FindSplit(data, PosByHint(data, hint));
-        data = Substr(data, 0, pos) + CodesToData(RandomCodes(Distrib(1, mutRad)(rnd))) + Substr(data, pos);
-        return pos;
-    }
-
-    int MutateRemoveRandomBytes(Data &data, int hint = -1) {
-        int pos = PosByHint(data, hint);
-        int next = pos + Distrib(1, mutRad)(rnd);
-        data = Substr(data, 0, pos) + Substr(data, next);
-        return pos;
-    }
-    int MutateRemoveRandomChars(Data &data, int hint = -1) {
-        int pos = FindSplit(data, PosByHint(data, hint));
-        int next = FindSplit(data, pos + Distrib(1, mutRad)(rnd));
-        data = Substr(data, 0, pos) + Substr(data, next);
-        return pos;
-    }
-
-    int MutateRevertBytes(Data &data, int hint = -1) {
-        int pos = PosByHint(data, hint);
-        int next = pos + Distrib(1, mutRad)(rnd);
-        data = Substr(data, 0, pos) + Reverse(Substr(data, pos, next)) + Substr(data, next);
-        return pos;
-    }
-
-    int MutateShortenEnd(Data &data, int hint = -1) {
-        int num = Distrib(1, mutRad)(rnd);
-        if (Distrib(0, 1)(rnd))
-            data = Substr(data, 0, data.size() - num);
-        else 
-            data = Substr(data, num);
-        return hint;
-    }
-
-    int MutateMakeOverlong(Data &data, int hint = -1) {
-        if (format != dfUtf8)
-            return hint;
-        int pos = FindSplit(data, PosByHint(data, hint));
-        const uint8_t *ptr = data.data() + pos;
-        try {
-            int code = ParseChar(data, ptr);
-            int next = ptr - data.data();
-            int len = next - pos;
-            len = Distrib(len, 4)(rnd);
-            Data prefD = Substr(data, 0, pos);
-            AddChar(prefD, code, len);
-            data = prefD + Substr(data, next);
-        }
-        catch (std::runtime_error &e) {}
-        return pos;
-    }
-
-    int MutateAddWrongCode(Data &data, int hint = -1) {
-        int pos = FindSplit(data, PosByHint(data, hint));
-        int code;
-        if (Distrib(0, 2)(rnd))
-            code = Distrib(0xD800, 0xE000)(rnd);
-        else
-            code = Distrib(0x10FFFF, 0x1FFFFF)(rnd);
-        data = Substr(data, 0, pos) + CodeToData(code) + Substr(data, pos);
-        return pos;
-    }
-
-//============ Mixes of several data ================
-
-    static Data MixConcatenate(const Data &a, const Data &b) {
-        return a + b;
-    }
-    Data MixOneInsideOther(const Data &a, const Data &b) {
-        int pos = RandomPos(a);
-        return Substr(a, 0, pos) + b + Substr(a, pos);
-    }
-    Data MixInterleaveBytes(const Data &a, const Data &b) {
-        Data res;
-        int pa = 0, pb = 0;
-        while (pa < a.size() || pb < b.size()) {
-            int q = Distrib(0, 1)(rnd);
-            if (q == 0 && pa < a.size())
-                res.push_back(a[pa++]);
-            if (q == 1 && pb < b.size())
-                res.push_back(b[pb++]);
-        }
-        return res;
-    }
-
-//============ apply many mutations ================
-
-    int MutateAny(Data &data, int hint = -1) {
-        int t = Distrib(0, 9)(rnd);
-        if (t == 0) return MutateDoubleBytes(data, hint);
-        if (t == 1) return MutateDoubleChars(data, hint);
-        if (t == 2) return MutateAddRandomBytes(data, hint);
-        if (t == 3) return MutateAddRandomChar(data, hint);
-        if (t == 4) return MutateRemoveRandomBytes(data, hint);
-        if (t == 5) return MutateRemoveRandomChars(data, hint);
-        if (t == 6) return MutateRevertBytes(data, hint);
-        if (t == 7) return MutateShortenEnd(data, hint);
-        if (t == 8) return MutateMakeOverlong(data, hint);
-        if (t == 9) return MutateAddWrongCode(data, hint);
-        return hint;
-    }
-
-    int MutateSeveral(Data &data, int hint = -1) {
-        int t = Distrib(0, 99)(rnd);
-        int k = 0;
-        if (t < 40) k = 1;
-        else if (t < 60) k = 2;
-        else if (t < 80) k = 5;
-        else k = 10;
-    
-        for (int i = 0; i < k; i++)
-            hint = MutateAny(data, hint);
-
-        return hint;
-    }
-};
-
 struct Result {
     bool success;
     int inDone;
@@ -512,7 +57,7 @@ Result SimpleConvert(const Data &data, DataFormat from, DataFormat to, int *maxB
 }
 
 //linked from AllProcessors.cpp
-BaseBufferProcessor *GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter = 0);
+BaseBufferProcessor *GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter = 0, bool withStats = false);
 
 Result TestedConvert(const Data &data, DataFormat from, DataFormat to, BaseBufferProcessor *processor) {
     long long outMaxSize = ConvertInMemorySize(*processor, data.size());
@@ -524,6 +69,159 @@ Result TestedConvert(const Data &data, DataFormat from, DataFormat to, BaseBuffe
     return Result(res.status == csSuccess, res.inputSize, std::move(answer));
 }
 
+//allocator which checks that every allocated block is freed with the same size and alignment
+class CheckingAllocator : public BaseAllocator {
+    long long blocks, bytes, alignments;
+public:
+    CheckingAllocator() : blocks(0), bytes(0), alignments(0) {}
+    virtual void *Allocate(size_t size, size_t alignment) {
+        blocks++;
+        bytes += size;
+        alignments += alignment;
+        return DefaultAllocator::Instance().Allocate(size, alignment);
+    }
+    virtual void Deallocate(void *ptr, size_t size, size_t alignment) {
+        blocks--;
+        bytes -= size;
+        alignments -= alignment;
+        DefaultAllocator::Instance().Deallocate(ptr, size, alignment);
+    }
+    bool AllFreed() const {
+        return blocks == 0 && bytes == 0 && alignments == 0;
+    }
+};
+
+//converts the whole data in one call of const 'Process' method (with caller-owned context)
+Result TestedConvertContext(const Data &data, const BaseBufferProcessor *processor, BaseBufferProcessor::Stats *stats = 0) {
+    int streams = processor->GetStreamsCount();
+    int outSize = (int)processor->GetOutputBufferMinSize(data.size());
+    std::vector<Data> outputs(streams, Data(outSize));
+    BaseBufferProcessor::Context ctx;
+    ctx.inputBuffer = (const char*)data.data();
+    ctx.inputSize = data.size();
+    for (int i = 0; i < streams; i++) {
+        ctx.outputBuffer[i] = (char*)outputs[i].data();
+        ctx.outputSize[i] = outSize;
+    }
+    ctx.stats = stats;
+    bool ok = processor->Process(ctx);
+    Data answer;
+    for (int i = 0; i < streams; i++)
+        answer.insert(answer.end(), outputs[i].begin(), outputs[i].begin() + ctx.outputDone[i]);
+    bool complete = (ctx.inputDone == (int)data.size());
+    return Result(ok && complete, ctx.inputDone, std::move(answer));
+}
+
+template<int SrcFormat, int DstFormat>
+Result TestedConvertInline(const Data &data) {
+    Data answer(ConvertInlineSize<SrcFormat, DstFormat>(data.size()));
+    auto res = ConvertInline<SrcFormat, DstFormat>((const char*)data.data(), data.size(), (char*)answer.data(), answer.size());
+    assert(res.status != csOverflowPossible);
+    assert(res.status != csInputOutputNoAccess);
+    answer.resize(res.outputSize);
+    return Result(res.status == csSuccess, res.inputSize, std::move(answer));
+}
+
+//header-only conversion is tested only with default settings (validation, MaxBytes = 3)
+Result TestedConvertInline(const Data &data, DataFormat from, DataFormat to) {
+    if (from == dfUtf8 && to == dfUtf16)
+        return TestedConvertInline<dfUtf8, dfUtf16>(data);
+    if (from == dfUtf8 && to == dfUtf32)
+        return TestedConvertInline<dfUtf8, dfUtf32>(data);
+    if (from == dfUtf16 && to == dfUtf8)
+        return TestedConvertInline<dfUtf16, dfUtf8>(data);
+    if (from == dfUtf32 && to == dfUtf8)
+        return TestedConvertInline<dfUtf32, dfUtf8>(data);
+    assert(0);
+    return Result();
+}
+
+//moves split position forward to the nearest code point boundary in data of given format
+int AlignToCodePoint(const Data &data, DataFormat format, int pos) {
+    int size = data.size();
+    if (format == dfUtf8) {
+        while (pos < size && (data[pos] & 0xC0U) == 0x80U)
+            pos++;
+    }
+    else {
+        int unit = (format == dfUtf16 ? 2 : 4);
+        pos = (pos + unit - 1) / unit * unit;
+        if (format == dfUtf16 && pos >= 2 && pos < size && (data[pos-1] & 0xFCU) == 0xD8U)
+            pos += 2;   //do not separate surrogate pair
+    }
+    return std::min(pos, size);
+}
+
+//splits data into many short strings at pseudo-random positions and converts them with ConvertBatch
+//the result for every string must be the same as the result of separate in-memory conversion
+//(all strings are converted one by one within one ConversionSession)
+//if splitAnywhere is false, then strings are split only at code point boundaries
+bool CheckBatchConvert(const Data &data, DataFormat from, BaseBufferProcessor *processor, bool splitAnywhere) {
+    std::vector<int> inputOffsets(1, 0);
+    uint32_t state = uint32_t(data.size()) * 2654435761U + 1;
+    while (inputOffsets.back() < (int)data.size()) {
+        state = state * 1103515245U + 12345U;
+        int len = (state >> 16) % ((state & 0x100) ? 40 : 400);
+        int pos = std::min(inputOffsets.back() + len, (int)data.size());
+        if (!splitAnywhere)
+            pos = AlignToCodePoint(data, from, pos);
+        inputOffsets.push_back(pos);
+    }
+    int count = int(inputOffsets.size()) - 1;
+
+    Data output(ConvertBatchSize(*processor, data.size()));
+    std::vector<int> outputOffsets(count + 1);
+    std::vector<unsigned char> statuses(count);
+    auto res = ConvertBatch(*processor, count, (const char*)data.data(), inputOffsets.data(), (char*)output.data(), output.size(), outputOffsets.data(), statuses.data());
+    if (res.status == csOverflowPossible || res.status == csInputOutputNoAccess)
+        return false;
+
+    ConversionSession session(*processor);
+    for (int i = 0; i < count; i++) {
+        Data str = Substr(data, inputOffsets[i], inputOffsets[i+1]);
+        Data answer(session.GetOutputSize(str.size()));
+        auto ans = session.Convert((const char*)str.data(), str.size(), (char*)answer.data(), answer.size());
+        answer.resize(ans.outputSize);
+        if (ans.status != statuses[i])
+            return false;
+        if (answer != Substr(output, outputOffsets[i], outputOffsets[i+1]))
+            return false;
+    }
+    return true;
+}
+
+//converts data with checksum plugin attached, and checks that the checksum matches the output
+//(also checks that hardware and software implementations of CRC-32C agree)
+bool CheckChecksum(const Data &data, BaseBufferProcessor *processor) {
+    ConversionSession session(*processor);
+    OutputChecksum checksum(*processor);
+    Data output(session.GetOutputSize(data.size()));
+    auto res = session.Convert((const char*)data.data(), data.size(), (char*)output.data(), output.size());
+    uint32_t expected = Crc32cSoftware(0, output.data(), size_t(res.outputSize));
+    if (HasHardwareCrc32c() && Crc32cHardware(0, output.data(), size_t(res.outputSize)) != expected)
+        return false;
+    return checksum.GetChecksum() == expected && checksum.GetChecksummedSize() == res.outputSize;
+}
+
+//checks that runtime statistics of processor are consistent with the conversion result
+bool CheckStats(const Result &res, DataFormat from, DataFormat to, const BaseBufferProcessor::Stats *stats) {
+    if (!stats)
+        return false;
+    if (stats->errorCallbacks != 0)
+        return false;
+    //note: multi-stream decoder may convert some data after the first error (then it is discarded)
+    long long convertedBytes = stats->fastBytes + stats->slowBytes;
+    if (res.success ? convertedBytes != res.inDone : convertedBytes < res.inDone)
+        return false;
+    //converted prefix is always valid, so its size in UTF-8 is known
+    long long utf8Size = 0;
+    for (int i = 0; i < 4; i++)
+        utf8Size += stats->codePoints[i] * (i + 1);
+    if (utf8Size != (from == dfUtf8 ? res.inDone : (long long)res.data.size()))
+        return false;
+    return true;
+}
+
 bool CheckResults(const Result &ans, const Result &out) {
     if (ans.success != out.success)
         return false;   //validity check failed
@@ -544,6 +242,65 @@ void DumpDataToFile(const Data *data, const char *filename) {
     }
 }
 
+Data LoadDataFromFile(const char *filename) {
+    Data data;
+    FILE *f = fopen(filename, "rb");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        data.resize(ftell(f));
+        fseek(f, 0, SEEK_SET);
+        data.resize(fread(data.data(), 1, data.size(), f));
+        fclose(f);
+    }
+    return data;
+}
+
+//converts data stored in temporary file with every file IO type (using small buffers and windows)
+//all results must be equal to the result of ftLibC, which must be equal to the answer
+bool CheckFileConvert(const Data &data, BaseBufferProcessor *processor, const Result &answer) {
+    static const char *InputPath = "test_file_in.bin";
+    static const char *OutputPath = "test_file_out.bin";
+    static const struct {
+        FileIOType type;
+        int bufferSize;
+        long long windowSize;
+    } configs[] = {
+        {ftLibC, 0, 0},                         //reference
+        {ftLibC, 300, 0},
+        {ftMemoryMapWhole, 0, 0},
+        {ftMemoryMapWindowed, 0, 1},            //rounded up to one page
+        {ftMemoryMapWindowed, 0, 3 * 4096 + 100},
+        {ftPosixAsync, 0, 0},
+        {ftPosixAsync, 300, 0},
+    };
+    DumpDataToFile(&data, InputPath);
+
+    Result reference;
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizeof(configs) / sizeof(configs[0]); i++) {
+        ConvertFilesSettings settings;
+        settings.type = configs[i].type;
+        settings.bufferSize = configs[i].bufferSize;
+        settings.windowSize = configs[i].windowSize;
+        auto res = ConvertFile(*processor, InputPath, OutputPath, settings);
+        if (res.status == csNotImplemented)
+            continue;       //e.g. ftMemoryMapWindowed on Windows
+        Data output = LoadDataFromFile(OutputPath);
+        if (res.status == csInputOutputNoAccess || res.outputSize != (long long)output.size()) {
+            ok = false;
+            break;
+        }
+        Result result(res.status == csSuccess, int(res.inputSize), std::move(output));
+        if (i == 0)
+            reference = result;
+        ok = CheckResults(reference, result);
+    }
+
+    remove(InputPath);
+    remove(OutputPath);
+    return ok && CheckResults(answer, reference);
+}
+
 //enabled by console parameter (allows saving crashing tests before they happened)
 bool DumpCurrentInput = false;
 
@@ -565,7 +322,9 @@ void RunTest(const Data &data, const std::string &name, const std::string *optio
             fclose(f);
         }
         
+        CheckingAllocator allocator;
         std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, bytes, mode, streams));
+        processor->SetAllocator(&allocator);
         auto result = TestedConvert(data, from, to, processor.get());
         printf("%c", (result.success ? '#' : 'o'));
 
@@ -584,6 +343,52 @@ void RunTest(const Data &data, const std::string &name, const std::string *optio
             }
             std::terminate();
         }
+
+        if (!data.empty() && !CheckResults(answer, TestedConvertContext(data, processor.get()))) {
+            printf("Context error!\n");
+            std::terminate();
+        }
+
+        //note: only "Validate" mode supports strings cut in the middle of a code point
+        if (!CheckBatchConvert(data, from, processor.get(), mode == 2)) {
+            printf("Batch error!\n");
+            std::terminate();
+        }
+
+        //the same conversion with non-temporal stores of output
+        processor->SetOutputStoreMode(BaseBufferProcessor::osStreaming);
+        if (!CheckResults(answer, TestedConvert(data, from, to, processor.get()))) {
+            printf("Streaming error!\n");
+            std::terminate();
+        }
+
+        if (!CheckChecksum(data, processor.get())) {
+            printf("Checksum error!\n");
+            std::terminate();
+        }
+
+        if (!allocator.AllFreed()) {
+            printf("Allocator error!\n");
+            std::terminate();
+        }
+
+        std::unique_ptr<BaseBufferProcessor> statsProcessor(GenerateProcessor(from, to, bytes, mode, streams, 0, true));
+        auto statsResult = TestedConvert(data, from, to, statsProcessor.get());
+        if (!CheckResults(answer, statsResult) || !CheckStats(statsResult, from, to, statsProcessor->GetStats())) {
+            printf("Stats error!\n");
+            std::terminate();
+        }
+        //const 'Process' counts into caller's statistics, and does not touch statistics of processor
+        if (!data.empty()) {
+            BaseBufferProcessor::Stats contextStats;
+            long long processorBytes = statsProcessor->GetStats()->fastBytes + statsProcessor->GetStats()->slowBytes;
+            auto contextResult = TestedConvertContext(data, statsProcessor.get(), &contextStats);
+            if (!CheckResults(answer, contextResult) || !CheckStats(contextResult, from, to, &contextStats) ||
+                statsProcessor->GetStats()->fastBytes + statsProcessor->GetStats()->slowBytes != processorBytes) {
+                printf("Context stats error!\n");
+                std::terminate();
+            }
+        }
     };
 
     auto RunDir = [&](DataFormat from, DataFormat to) -> void {
@@ -608,6 +413,11 @@ void RunTest(const Data &data, const std::string &name, const std::string *optio
                 }
             }
 
+        if (!CheckResults(answer, TestedConvertInline(data, from, to))) {
+            printf("Inline error!\n");
+            std::terminate();
+        }
+
         printf("]");
     };
 
@@ -631,6 +441,46 @@ void RunTest(const Data &data, const std::string &name, const std::string *optio
     printf("\n");
 }
 
+//checks conversion of files: it is much slower than in-memory conversion, so it is run on few inputs
+void RunFileTestF(const Data &data, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    char name[256];
+    vsprintf(name, format, args);
+    va_end(args);
+    std::string str(data.begin(), data.end());
+    uint32_t hash = std::hash<std::string>()(str);
+    printf("%30s [%7u] (%08X):   ", name, unsigned(data.size()), hash);
+
+    for (int from = 0; from < dfUtfCount; from++)
+        for (int to = 0; to < dfUtfCount; to++) {
+            if ((from == dfUtf8) == (to == dfUtf8))
+                continue;
+            Result answer = SimpleConvert(data, DataFormat(from), DataFormat(to));
+            printf(" %c[", (answer.success ? '#' : 'o'));
+
+            static const int streams[] = {1, 4};
+            for (int s = 0; s < 2; s++) {
+                CheckingAllocator allocator;
+                std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(from, to, 3, 2, streams[s]));
+                processor->SetAllocator(&allocator);
+                if (!CheckFileConvert(data, processor.get(), answer)) {
+                    printf("File error!\n");
+                    std::terminate();
+                }
+                if (!allocator.AllFreed()) {
+                    printf("Allocator error!\n");
+                    std::terminate();
+                }
+                printf("#");
+            }
+
+            printf("]");
+        }
+
+    printf("\n");
+}
+
 void RunTestF(const Data &data, const char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -687,6 +537,27 @@ int main(int argc, char **argv) {
                 RunTestF(gen.CodesToData(gen.RandomCodes(i, b)), "%d_random_codes(%d)_%d", fmt, b, i);
     }
 
+    printf("\n");
+
+    //largest inputs span several blocks of ftPosixAsync and many windows of ftMemoryMapWindowed
+    RunFileTestF(Data(), "file_empty");
+    RunFileTestF(gl.RandomBytes(5000), "file_random_bytes");
+    for (int fmt = 0; fmt < dfUtfCount; fmt++) {
+        TestsGenerator gen(DataFormat(fmt), rnd);
+        //code point without its last byte
+        Data incomplete = gen.CodesToData(std::vector<int>(1, int(gen.MaxCode)));
+        incomplete.pop_back();
+
+        static const int lens[] = {100, 5000, 600000};
+        for (int i = 0; i < 3; i++) {
+            Data data = gen.CodesToData(gen.RandomCodes(lens[i]));
+            RunFileTestF(data, "%d_file_codes_%d", fmt, lens[i]);
+            RunFileTestF(data + incomplete, "%d_file_codes_%d_T", fmt, lens[i]);
+            gen.MutateSeveral(data);
+            RunFileTestF(data, "%d_file_codes_%d_M", fmt, lens[i]);
+        }
+    }
+
     printf("\n");
     printf("================================================================================\n");
     printf("                                                                                \n");
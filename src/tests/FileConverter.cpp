@@ -6,6 +6,9 @@
 #include "buffer/ProcessorSelector.h"
 #include "message/MessageConverter.h"
 #include "core/ProcessTrivial.h"    //only for random inputs
+#include "tests/CorpusGenerator.h"  //only for random inputs
+#include "base/CacheInfo.h"
+#include "base/PerfCounters.h"
 
 const int MAX_POS_ARGS = 2;
 const int MAX_ARG_LEN = 1<<12;
@@ -43,6 +46,18 @@ int GetFormatOfEncoding(const char *encoding) {
     Check(false, "Unknown encoding: %s\n", encoding);
     return -1;
 }
+int GetFileIOType(const char *name) {
+    if (strcmp(name, "libc") == 0)
+        return ftLibC;
+    if (strcmp(name, "mmap") == 0)
+        return ftMemoryMapWhole;
+    if (strcmp(name, "mmapwin") == 0)
+        return ftMemoryMapWindowed;
+    if (strcmp(name, "async") == 0)
+        return ftPosixAsync;
+    Check(false, "Unknown IO type: %s\n", name);
+    return -1;
+}
 const char *GetFormatStr(int format) {
     if (format == dfUtf8 ) return "UTF-8 ";
     if (format == dfUtf16) return "UTF-16";
@@ -63,8 +78,17 @@ struct Config {
     char dstPath[MAX_ARG_LEN];
     int srcRandomLen;           // input: [rnd%c%c%c%c:%d]
     bool srcRandomChars[4];     // -- | --
+    int srcCorpusProfile;       // input: [rnd-%s:%d] or [rnd-%s:%d:%d]
+    int srcCorpusAsciiRun;      // -- | --
     bool dstPrintHash;          // output: [hash]
+    bool dstPrintCrc;           // output: [crc32c]
     bool countBytes;            // --countbytes
+    int bufferSize;             // -bs=%d
+    bool sweepChunkSize;        // --sweepchunk
+    int fileIOType;             // --io=%s
+    long long windowSize;       // --window=%lld
+    bool printStats;            // --stats
+    char timingJsonPath[MAX_ARG_LEN];   // --timingjson=%s
     
     Config() {
         srcFormat = dfUtf8;
@@ -78,8 +102,21 @@ struct Config {
         srcPath[0] = 0;
         dstPath[0] = 0;
         srcRandomLen = -1;
+        srcCorpusProfile = -1;
+        srcCorpusAsciiRun = 0;
         dstPrintHash = false;
+        dstPrintCrc = false;
         countBytes = false;
+        bufferSize = 0;
+        sweepChunkSize = false;
+#if defined(_WIN32) || defined(__linux__)
+        fileIOType = ftMemoryMapWhole;
+#else
+        fileIOType = ftLibC;
+#endif
+        windowSize = 0;
+        printStats = false;
+        timingJsonPath[0] = 0;
     }
     void Init() {
         Check(numberOfRuns >= 0, "Cannot run negative number of times: %d\n", numberOfRuns);
@@ -89,6 +126,8 @@ struct Config {
         Check(maxBytesFast >= 0 && maxBytesFast <= 3, "Fast path can process up to 1-byte, 2-byte, or 3-byte code points (%d)\n", maxBytesFast);
         Check(checkMode >= cmFast && checkMode <= cmValidate, "Checking mode must be 0 (fast), 1 (full), or 2 (validate)  (%d)", checkMode);
         Check(!countBytes || (srcFormat == dfUtf8 && !fileToFile), "Counting bytes is only implemented for UTF-8 input and memory-to-memory");
+        Check(bufferSize >= 0, "Buffer size cannot be negative: %d\n", bufferSize);
+        Check(!sweepChunkSize || !fileToFile, "Sweeping chunk size is only implemented for memory-to-memory\n");
         if (maxBytesFast == 0) {
             logprintf("Note: trivial convertion is used (no fast path)\n");
             checkMode = cmValidate;
@@ -115,12 +154,23 @@ struct Config {
             char temp[16], tl = 0;
             for (int t = 0; t < 4; t++) if (srcRandomChars[t]) temp[tl++] = '1' + t;
             temp[tl] = 0;
-            sprintf(randomSrcMessage, "[random: %d chars of [%s]]", srcRandomLen, temp);
+            if (srcCorpusProfile >= 0)
+                sprintf(randomSrcMessage, "[random: %d chars of %s text]", srcRandomLen, GetCorpusProfileName(srcCorpusProfile));
+            else
+                sprintf(randomSrcMessage, "[random: %d chars of [%s]]", srcRandomLen, temp);
+            if (srcCorpusAsciiRun > 0)
+                sprintf(randomSrcMessage + strlen(randomSrcMessage) - 1, " with ASCII runs of %d on average]", srcCorpusAsciiRun);
         }
         logprintf("  Input (source) in %s: %s\n", GetFormatStr(srcFormat), (srcRandomLen >= 0 ? randomSrcMessage : srcPath));
-        logprintf("  Output (dest.) in %s: %s\n", GetFormatStr(dstFormat), (dstPrintHash ? "[print hash]" : dstPath));
+        logprintf("  Output (dest.) in %s: %s\n", GetFormatStr(dstFormat), (dstPrintHash ? "[print hash]" : dstPrintCrc ? "[print crc32c]" : dstPath));
         if (fileToFile) 
             logprintf("  Direct file-to-file conversion\n");
+        if (bufferSize > 0)
+            logprintf("  Buffer size: %d bytes\n", bufferSize);
+        if (sweepChunkSize)
+            logprintf("  Sweep over chunk sizes\n");
+        if (printStats)
+            logprintf("  Collect runtime statistics of processor\n");
 
         logprintf("Processor settings:\n");
         logprintf("  Fast path supports code points with up to %d bytes in UTF-8\n", maxBytesFast);
@@ -138,7 +188,7 @@ struct Config {
 
 
 //linked from AllProcessors.cpp
-BaseBufferProcessor* GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter);
+BaseBufferProcessor* GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter, bool withStats);
 
 void ReadFileContents(const char *filename, char *&buffer, long long &size) {
     assert(!buffer);
@@ -148,14 +198,18 @@ void ReadFileContents(const char *filename, char *&buffer, long long &size) {
     size = ftell(fi);
     fseek(fi, 0, SEEK_SET);
     buffer = new char[size];
+    TIMING_START(IO);
     fread(buffer, 1, size, fi);
+    TIMING_END(IO, size);
     fclose(fi);
 }
 
 void WriteFileContents(const char *filename, char *buffer, long long size) {
     FILE *fo = fopen(filename, "wb");
     Check(fo, "Cannot open file: %s\n", filename);
+    TIMING_START(IO);
     fwrite(buffer, 1, size, fo);
+    TIMING_END(IO, size);
     fclose(fo);
 }
 
@@ -216,6 +270,15 @@ void GenerateRandomSource(char *&buffer, long long &size, int format, int cnt, b
     size = buff16end - buff16;
 }
 
+void GenerateCorpusSource(char *&buffer, long long &size, int format, int cnt, const CorpusSettings &settings) {
+    assert(!buffer);
+    std::vector<char> text;
+    GenerateCorpus(text, settings, format, 4LL * cnt, cnt, 0);
+    size = text.size();
+    buffer = new char[size + 1];
+    memcpy(buffer, text.data(), size);
+}
+
 
 bool IsSameResult (const ConversionResult &a, const ConversionResult &b) {
     return a.status == b.status && a.inputSize == b.inputSize && a.outputSize == b.outputSize;
@@ -267,6 +330,69 @@ void PrintByteCounts(const char *buffer, long long size) {
     logprintf("UTF-32 size: %" PRId64 "\n", u32size);
 }
 
+void PrintProcessorStats(const BaseBufferProcessor &processor) {
+    const BaseBufferProcessor::Stats *stats = processor.GetStats();
+    if (!stats)
+        return;
+    long long totalBytes = stats->fastBytes + stats->slowBytes;
+    logprintf("Processor statistics:\n");
+    logprintf("  Fast path: %" PRId64 " blocks, %" PRId64 " bytes (%0.2lf%%)\n", stats->fastBlocks, stats->fastBytes, 100.0 * stats->fastBytes / DMAX(totalBytes, 1LL));
+    logprintf("  Slow path: %" PRId64 " calls, %" PRId64 " bytes (%0.2lf%%)\n", stats->slowCalls, stats->slowBytes, 100.0 * stats->slowBytes / DMAX(totalBytes, 1LL));
+    logprintf("  Error callbacks: %" PRId64 "\n", stats->errorCallbacks);
+    logprintf("  Code points by UTF-8 length:");
+    for (int i = 0; i < 4; i++) logprintf(" %" PRId64, stats->codePoints[i]);
+    logprintf("\n");
+    logprintf("  Cycles in processor: %" PRId64 " (%0.3lf cyc/byte)\n", stats->cycles, double(stats->cycles) / DMAX(totalBytes, 1LL));
+}
+
+void PrintHardwareCounters(const HardwareCounters &counters, bool available, double elems) {
+    if (!available) {
+        logprintf("Hardware counters :  not available\n");
+        return;
+    }
+    logprintf("Hardware counters (per input byte):\n");
+    for (int i = 0; i < hcCount; i++) {
+        if (counters.IsAvailable(i))
+            logprintf("  %14s :  %0.4lf\n", HardwareCounters::GetName(i), counters.GetValue(i) / elems);
+        else
+            logprintf("  %14s :  not available\n", HardwareCounters::GetName(i));
+    }
+    if (counters.IsAvailable(hcCycles) && counters.IsAvailable(hcInstructions) && counters.GetValue(hcCycles) > 0)
+        logprintf("  %14s :  %0.3lf\n", "IPC", double(counters.GetValue(hcInstructions)) / counters.GetValue(hcCycles));
+}
+
+//measures conversion speed for every chunk size (power of two)
+//Note: the same as ConvertInMemory, but with explicitly set chunk size
+void RunChunkSizeSweep(BaseBufferProcessor &processor, const char *inputData, long long inputSize, char *outputData, long long outputSize, int runs) {
+    static const int MinChunkLog = 10, MaxChunkLog = 24;
+    int recommended = processor.GetInputBufferRecommendedSize();
+    const CacheSizes &caches = GetCacheSizes();
+    logprintf("Detected caches: L1d = %dK  L2 = %dK  L3 = %dK\n", caches.l1d >> 10, caches.l2 >> 10, caches.l3 >> 10);
+    logprintf("Recommended chunk size: %d\n", recommended);
+    double bestTime = 1e+100;
+    int bestChunk = -1;
+    for (int lg = MinChunkLog; lg <= MaxChunkLog; lg++) {
+        int chunk = 1 << lg;
+        uint64_t startTicks = get_ticks();
+        for (int r = 0; r < runs; r++) {
+            processor.Clear();
+            ContiguousInput input(processor, inputData, inputSize, chunk);
+            ContiguousOutput output(processor, outputData, outputSize, chunk);
+            while (!input.Finished())
+                if (!processor.Process())
+                    break;
+        }
+        uint64_t endTicks = get_ticks();
+        double ticksPerElem = double(endTicks - startTicks) / runs / (inputSize + 1e-9);
+        logprintf("  chunk %8d : %6.3lf cyc/el%s\n", chunk, ticksPerElem, (chunk == recommended ? "  (recommended)" : ""));
+        if (bestTime > ticksPerElem) {
+            bestTime = ticksPerElem;
+            bestChunk = chunk;
+        }
+    }
+    logprintf("Optimal chunk size: %d (%0.3lf cyc/el)\n", bestChunk, bestTime);
+}
+
 void PrintHelp() {
     logprintf(
         "Small converter tool intended for demonstration and benchmarking of utf8lut.\n"
@@ -291,6 +417,25 @@ void PrintHelp() {
         "       Perform the conversion <%%d> times in a row.\n"
         "       Usually reading and writing files is NOT repeated, but in file-to-file mode it is.\n"
         "       Default: -k=1\n"
+        "   -bs=%%d\n"
+        "       Sets size of input buffer used in file-to-file mode (in bytes).\n"
+        "       Default: -bs=0   (processor chooses it according to CPU cache sizes)\n"
+        "   --io=libc | --io=mmap | --io=mmapwin | --io=async\n"
+        "       Sets how files are read and written in file-to-file mode: with fread/fwrite,\n"
+        "       by mapping whole files into memory, by mapping sliding windows of files (POSIX only),\n"
+        "       or asynchronously with io_uring on Linux (see FileIOType in MessageConverter.h).\n"
+        "       Default: --io=mmap on Windows and Linux, --io=libc elsewhere\n"
+        "   --window=%%lld\n"
+        "       Sets size of windows (in bytes) with --io=mmapwin (not available on Windows).\n"
+        "       Default: --window=0   (256 MB)\n"
+        "   --sweepchunk\n"
+        "       Measure speed of memory-to-memory conversion with chunk sizes from 1KB to 16MB.\n"
+        "       Prints the optimal chunk size and the size recommended by processor.\n"
+        "   --stats\n"
+        "       Collect and print runtime statistics of processor: data processed by fast/slow path,\n"
+        "       histogram of code point lengths, cycles spent. Note that it slows conversion down.\n"
+        "   --timingjson=%%s\n"
+        "       Write internal timings (with per-call latency histograms) to file <%%s> in JSON format.\n"
         "   -ec\n"
         "       Enable error conversion which turns problematic code units into 0xFFFD repl. code points.\n"
         "       By default converter simply stops on the first error (given that validation is enabled).\n"
@@ -318,9 +463,17 @@ void PrintHelp() {
         "       Each of them forbids or allows code points of corresponding byte size in UTF-8.\n"
         "       The number <%%d> after semicolon sets how many code points are there in the input.\n"
         "       Note that generation is quite slow, and random tests are very different from the real ones.\n"
+        "   <input_file_path>:   [rnd-%%s:%%d]  or  [rnd-%%s:%%d:%%d]    (with brackets)\n"
+        "       Generate synthetic text which resembles real data of the profile <%%s>:\n"
+        "       english, russian, chinese, emoji, json, html.\n"
+        "       The first number sets how many code points are there in the input.\n"
+        "       The optional second number sets mean length of long ASCII runs (e.g. text or markup).\n"
         "   <output_file_path>:  [hash]     (with brackets)\n"
         "       Calculate hash of the output data instead of writing it to a file.\n"
         "       Polynomial hash with base 31 modulo 2^32 is printed to log.\n"
+        "   <output_file_path>:  [crc32c]   (with brackets)\n"
+        "       Calculate CRC-32C checksum of the output data instead of writing it to a file.\n"
+        "       It is computed during conversion (see OutputChecksum plugin), without separate pass over output.\n"
     );
     exit(1);
 }
@@ -340,6 +493,7 @@ int main(int argc, char **argv) {
         strtolower(larg);
 
         int num;
+        long long lnum;
         char str[MAX_ARG_LEN];
 
         if (0);
@@ -359,6 +513,18 @@ int main(int argc, char **argv) {
             cfg.fileToFile = true;
         else if (strcmp(larg, "--countbytes") == 0)
             cfg.countBytes = true;
+        else if (sscanf(larg, "-bs=%d", &num) == 1)
+            cfg.bufferSize = num;
+        else if (sscanf(larg, "--io=%s", &str) == 1)
+            cfg.fileIOType = GetFileIOType(str);
+        else if (sscanf(larg, "--window=%lld", &lnum) == 1)
+            cfg.windowSize = lnum;
+        else if (strcmp(larg, "--sweepchunk") == 0)
+            cfg.sweepChunkSize = true;
+        else if (strcmp(larg, "--stats") == 0)
+            cfg.printStats = true;
+        else if (strncmp(larg, "--timingjson=", 13) == 0)
+            strcpy(cfg.timingJsonPath, arg + 13);
         else if (strcmp(larg, "-ec") == 0)
             cfg.errorCorrection = true;
         else if (sscanf(larg, "-k=%d", &num) == 1)
@@ -366,7 +532,15 @@ int main(int argc, char **argv) {
         else if (larg[0] != '-') {
             Check(posArgsCnt < MAX_POS_ARGS, "No more positional arguments allowed: %s\n", arg);
             if (0 == posArgsCnt) {
-                if (sscanf(larg, "[rnd%c%c%c%c:%d]", str+0, str+1, str+2, str+3, &num) == 5) {
+                int asciiRun = 0;
+                if (sscanf(larg, "[rnd-%31[a-z]:%d:%d]", str, &num, &asciiRun) >= 2) {
+                    cfg.srcCorpusProfile = GetCorpusProfileByName(str);
+                    Check(cfg.srcCorpusProfile >= 0, "Unknown profile of random text: %s\n", str);
+                    Check(num >= 0 && asciiRun >= 0, "Wrong parameters of random text: %s\n", arg);
+                    cfg.srcRandomLen = num;
+                    cfg.srcCorpusAsciiRun = asciiRun;
+                }
+                else if (sscanf(larg, "[rnd%c%c%c%c:%d]", str+0, str+1, str+2, str+3, &num) == 5) {
                     cfg.srcRandomLen = num;
                     for (int t = 0; t < 4; t++)
                         cfg.srcRandomChars[t] = strchr("1tTyY+", str[t]) != 0;
@@ -377,6 +551,8 @@ int main(int argc, char **argv) {
             if (1 == posArgsCnt) {
                 if (strcmp(larg, "[hash]") == 0)
                     cfg.dstPrintHash = true;
+                else if (strcmp(larg, "[crc32c]") == 0)
+                    cfg.dstPrintCrc = true;
                 else
                     strcpy(cfg.dstPath, arg);
             }
@@ -397,31 +573,40 @@ int main(int argc, char **argv) {
         cfg.maxBytesFast,
         cfg.checkMode,
         cfg.smallConverter ? 1 : 4,
-        cfg.errorCorrection ? &errorCounter : 0
+        cfg.errorCorrection ? &errorCounter : 0,
+        cfg.printStats
     );
     Check(processor, "Cannot generate processor with specified parameters!\n");
     //logprintf("Generated processor for conversion\n");
 
     ConversionResult allResult;
+    //hardware counters measure only the conversion runs
+    HardwareCounters counters;
+    bool countersOk = false;
     clock_t startTime = clock();
     uint64_t startTicks = get_ticks();
     if (cfg.fileToFile) {
+        countersOk = counters.Start();
         for (int r = 0; r < cfg.numberOfRuns; r++) {
             ConvertFilesSettings settings;
-#ifdef _WIN32
-            settings.type = ftMemoryMapWhole;
-#endif
+            settings.bufferSize = cfg.bufferSize;
+            settings.type = FileIOType(cfg.fileIOType);
+            settings.windowSize = cfg.windowSize;
             ConversionResult convres = ConvertFile(*processor, cfg.srcPath, cfg.dstPath, settings);
             if (r && !IsSameResult(allResult, convres))
                 logprintf("Consecutive conversion runs produce different results!\n");
             allResult = convres;
         }
+        counters.Stop();
     }
     else {
         char *inputData = 0;
         long long inputSize = 0;
         if (cfg.srcRandomLen >= 0) {
-            GenerateRandomSource(inputData, inputSize, cfg.srcFormat, cfg.srcRandomLen, cfg.srcRandomChars);
+            if (cfg.srcCorpusProfile >= 0)
+                GenerateCorpusSource(inputData, inputSize, cfg.srcFormat, cfg.srcRandomLen, CorpusSettings(cfg.srcCorpusProfile, cfg.srcCorpusAsciiRun));
+            else
+                GenerateRandomSource(inputData, inputSize, cfg.srcFormat, cfg.srcRandomLen, cfg.srcRandomChars);
             logprintf("Generated random input buffer\n");
         }
         else {
@@ -434,25 +619,49 @@ int main(int argc, char **argv) {
         char *outputData = 0;
         long long outputSize = ConvertInMemorySize(*processor, inputSize, &outputData);
 
+        if (cfg.sweepChunkSize) {
+            //sweep is not a part of the task: exclude its duration from total time
+            clock_t sweepStartTime = clock();
+            uint64_t sweepStartTicks = get_ticks();
+            RunChunkSizeSweep(*processor, inputData, inputSize, outputData, outputSize, DMAX(cfg.numberOfRuns, 1));
+            startTime += clock() - sweepStartTime;
+            startTicks += get_ticks() - sweepStartTicks;
+        }
+        processor->ResetStats();
+
+        uint32_t crc = 0;
+        countersOk = counters.Start();
         for (int r = 0; r < cfg.numberOfRuns; r++) {
-            ConversionResult convres = ConvertInMemory(*processor, inputData, inputSize, outputData, outputSize);
+            ConversionResult convres;
+            if (cfg.dstPrintCrc) {
+                //the same as ConvertInMemory, but with checksum plugin attached
+                ConversionSession session(*processor);
+                OutputChecksum checksum(*processor);
+                convres = session.Convert(inputData, inputSize, outputData, outputSize);
+                crc = checksum.GetChecksum();
+            }
+            else
+                convres = ConvertInMemory(*processor, inputData, inputSize, outputData, outputSize);
             if (r && !IsSameResult(allResult, convres))
                 logprintf("Consecutive conversion runs produce different results!\n");
             allResult = convres;
         }
+        counters.Stop();
         logprintf("Conversion%s complete\n", (cfg.numberOfRuns == 1 ? "" : " (all runs)"));
 
         if (cfg.dstPrintHash) {
             unsigned int hash = GetHashOfBuffer(outputData, allResult.outputSize);
             logprintf("Computed hash value of output: %08X\n", hash);
         }
+        else if (cfg.dstPrintCrc)
+            logprintf("Computed CRC-32C of output: %08X\n", crc);
         else {
             WriteFileContents(cfg.dstPath, outputData, allResult.outputSize);
             logprintf("Wrote output buffer to file\n");
         }
 
         delete[] inputData;
-        delete[] outputData;
+        ConvertInMemoryFree(*processor, inputSize, outputData);
         logprintf("\n");
     }
     clock_t endTime = clock();
@@ -461,6 +670,7 @@ int main(int argc, char **argv) {
 
     logprintf("The task was finished in %0.3f seconds\n", elapsedTime);
     PrintResult(allResult);
+    PrintProcessorStats(*processor);
     if (cfg.errorCorrection) {
         if (errorCounter > 0)
             logprintf("Fixed erratic code units: %d\n", errorCounter);
@@ -480,9 +690,16 @@ int main(int argc, char **argv) {
         logprintf("Internal timings:\n");
         TimingPrintAll(LOG_FILE);
     }
+    if (cfg.timingJsonPath[0]) {
+        FILE *f = fopen(cfg.timingJsonPath, "wt");
+        Check(f, "Cannot open file: %s\n", cfg.timingJsonPath);
+        TimingExportJson(f);
+        fclose(f);
+    }
 #endif
     double ticksPerElem = double(endTicks - startTicks) / cfg.numberOfRuns / allResult.inputSize;
     logprintf("From total time   :  %0.3lf cyc/el\n", ticksPerElem);
+    PrintHardwareCounters(counters, countersOk, double(cfg.numberOfRuns) * allResult.inputSize);
 
     return 0;
 }
@@ -0,0 +1,305 @@
+// Profiler of accesses to lookup tables.
+// It converts a file with processor which counts lookups into every LUT entry,
+// then prints the set of hot entries and how many cache lines / pages they occupy.
+// Optionally, it generates profile-guided order of LUT entries (hot entries first)
+// and compares speed of lookups in original table and in reordered table (with index remap).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "buffer/ProcessorSelector.h"
+#include "message/MessageConverter.h"
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
+
+static const int CacheLineSize = 64;
+static const int PageSize = 4096;
+
+struct Config {
+    int srcFormat;              // -s=%s
+    int dstFormat;              // -d=%s
+    int maxBytesFast;           // -b=%d
+    int checkMode;              // -m=%d
+    int topCount;               // --top=%d
+    const char *remapPath;      // --remap=%s
+    bool replay;                // --replay
+    const char *inputPath;
+
+    Config() {
+        srcFormat = dfUtf8;
+        dstFormat = dfUtf16;
+        maxBytesFast = 3;
+        checkMode = cmValidate;
+        topCount = 20;
+        remapPath = 0;
+        replay = false;
+        inputPath = 0;
+    }
+};
+
+void PrintHelp() {
+    printf(
+        "Usage:\n"
+        "  LutProfiler [options] <input_file>\n"
+        "Options:\n"
+        "  -s=%%s, -d=%%s   source / destination encoding: utf8, utf16, utf32 (default: -s=utf8 -d=utf16)\n"
+        "  -b=%%d          max bytes of fast path: 2 or 3 (default: 3)\n"
+        "  -m=%%d          checking mode: 1 (full) or 2 (validate), defines LUT entry size (default: 2)\n"
+        "  --top=%%d       number of hottest entries to print (default: 20)\n"
+        "  --remap=%%s     write profile-guided order of LUT entries to file <%%s> as C array\n"
+        "  --replay       measure lookups into original and reordered tables (on the same input)\n"
+    );
+    exit(1);
+}
+
+int GetFormatOfEncoding(const char *encoding) {
+    if (strcmp(encoding, "utf8") == 0 || strcmp(encoding, "utf-8") == 0)
+        return dfUtf8;
+    if (strcmp(encoding, "utf16") == 0 || strcmp(encoding, "utf-16") == 0)
+        return dfUtf16;
+    if (strcmp(encoding, "utf32") == 0 || strcmp(encoding, "utf-32") == 0)
+        return dfUtf32;
+    return -1;
+}
+
+//only single-stream processors are instantiated here (multiple streams do not change LUT accesses)
+BaseBufferProcessor *CreateProfilingProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode) {
+    #define TRY_PROC(from, to, maxB, mode) \
+        if (srcFormat == from && dstFormat == to && maxBytes == maxB && checkMode == mode) \
+            return ProcessorSelector<from, to>::template WithOptions<mode, maxB, 1, true>::Create();
+    #define TRY_DIR(from, to) \
+        TRY_PROC(from, to, 2, cmFull); \
+        TRY_PROC(from, to, 3, cmFull); \
+        TRY_PROC(from, to, 2, cmValidate); \
+        TRY_PROC(from, to, 3, cmValidate);
+    TRY_DIR(dfUtf8, dfUtf16);
+    TRY_DIR(dfUtf8, dfUtf32);
+    TRY_DIR(dfUtf16, dfUtf8);
+    TRY_DIR(dfUtf32, dfUtf8);
+    return 0;
+}
+
+//returns sequence of LUT indices in the order of fast path lookups (approximately)
+//note: blocks with unsupported code points are simply skipped
+std::vector<int> GetLookupSequence(const Config &cfg, const char *data, long long size) {
+    std::vector<int> res;
+    if (cfg.srcFormat == dfUtf8) {
+        const DecoderLutEntry<true> *table = DecoderLutTable<true>::GetArray();
+        for (long long pos = 0; pos + 16 <= size; ) {
+            int idx = GetDecoderLutIndex(data + pos);
+            if (table[idx].dstStep == 0) {
+                pos++;      //invalid mask, resynchronize
+                continue;
+            }
+            res.push_back(idx);
+            pos += table[idx].srcStep;
+        }
+    }
+    else {
+        int unit = (cfg.srcFormat == dfUtf16 ? 2 : 4);
+        for (long long pos = 0; pos + 8 * unit <= size; pos += 8 * unit) {
+            int indices[2], cnt;
+            if (cfg.maxBytesFast == 2)
+                cnt = (unit == 2 ? GetEncoderLutIndices<2, 2>(data + pos, indices) : GetEncoderLutIndices<2, 4>(data + pos, indices));
+            else
+                cnt = (unit == 2 ? GetEncoderLutIndices<3, 2>(data + pos, indices) : GetEncoderLutIndices<3, 4>(data + pos, indices));
+            for (int i = 0; i < cnt; i++)
+                res.push_back(indices[i]);
+        }
+    }
+    return res;
+}
+
+//measures average cycles per lookup when visiting given sequence of entries
+//every entry is 'entrySize' bytes long, 'remap' (if not null) is applied to every index first
+double MeasureLookups(const std::vector<int> &sequence, const char *table, int entrySize, const uint16_t *remap, int runs) {
+    double best = 1e+100;
+    volatile uint32_t sink = 0;
+    for (int r = 0; r < runs; r++) {
+        uint32_t acc = 0;
+        uint64_t start = __rdtsc();
+        for (size_t i = 0; i < sequence.size(); i++) {
+            int idx = sequence[i];
+            if (remap)
+                idx = remap[idx];
+            //make next index dependent on loaded data (like pointer increment in the cores)
+            acc += *(const uint32_t*)(table + size_t(idx) * entrySize + (acc & 4));
+        }
+        uint64_t end = __rdtsc();
+        sink = sink + acc;
+        best = std::min(best, double(end - start) / std::max<size_t>(sequence.size(), 1));
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    Config cfg;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int num;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+            PrintHelp();
+        else if (strncmp(arg, "-s=", 3) == 0)
+            cfg.srcFormat = GetFormatOfEncoding(arg + 3);
+        else if (strncmp(arg, "-d=", 3) == 0)
+            cfg.dstFormat = GetFormatOfEncoding(arg + 3);
+        else if (sscanf(arg, "-b=%d", &num) == 1)
+            cfg.maxBytesFast = num;
+        else if (sscanf(arg, "-m=%d", &num) == 1)
+            cfg.checkMode = num;
+        else if (sscanf(arg, "--top=%d", &num) == 1)
+            cfg.topCount = num;
+        else if (strncmp(arg, "--remap=", 8) == 0)
+            cfg.remapPath = arg + 8;
+        else if (strcmp(arg, "--replay") == 0)
+            cfg.replay = true;
+        else if (arg[0] != '-' && !cfg.inputPath)
+            cfg.inputPath = arg;
+        else
+            PrintHelp();
+    }
+    if (!cfg.inputPath)
+        PrintHelp();
+    if (cfg.srcFormat != dfUtf8 && cfg.dstFormat == dfUtf16)
+        cfg.dstFormat = dfUtf8;     //default destination for encoders
+
+    BaseBufferProcessor *processor = CreateProfilingProcessor(cfg.srcFormat, cfg.dstFormat, cfg.maxBytesFast, cfg.checkMode);
+    if (!processor) {
+        printf("Unsupported settings: only -b=2/3 and -m=1/2 have LUT\n");
+        return 1;
+    }
+
+    //read input file
+    FILE *f = fopen(cfg.inputPath, "rb");
+    if (!f) {
+        printf("Cannot open file: %s\n", cfg.inputPath);
+        return 1;
+    }
+    std::vector<char> input;
+    char chunk[1<<16];
+    while (size_t cnt = fread(chunk, 1, sizeof(chunk), f))
+        input.insert(input.end(), chunk, chunk + cnt);
+    fclose(f);
+    long long inputSize = input.size();
+
+    //convert with LUT histogram enabled
+    std::vector<long long> hist(BaseBufferProcessor::MaxLutEntries, 0);
+    processor->SetLutHistogram(hist.data());
+    char *output = 0;
+    long long outputSize = ConvertInMemorySize(*processor, inputSize, &output);
+    ConversionResult res = ConvertInMemory(*processor, input.data(), inputSize, output, outputSize);
+    ConvertInMemoryFree(*processor, inputSize, output);
+    printf("Converted %lld bytes (status %d)\n", res.inputSize, res.status);
+
+    const BaseBufferProcessor::Stats *stats = processor->GetStats();
+    printf("Fast path: %lld bytes in %lld blocks, slow path: %lld bytes\n", stats->fastBytes, stats->fastBlocks, stats->slowBytes);
+    delete processor;
+
+    //parameters of the table
+    bool decoder = (cfg.srcFormat == dfUtf8);
+    int entriesCount = (decoder ? 32768 : 256);
+    int entrySize = (decoder ? (cfg.checkMode == cmValidate ? sizeof(DecoderLutEntry<true>) : sizeof(DecoderLutEntry<false>)) : sizeof(EncoderLutEntry));
+    printf("LUT: %d entries of %d bytes (%d KB)\n", entriesCount, entrySize, entriesCount * entrySize / 1024);
+
+    //sort entries by number of lookups
+    std::vector<int> order(entriesCount);
+    for (int i = 0; i < entriesCount; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return hist[a] > hist[b]; });
+    long long totalLookups = 0;
+    int usedEntries = 0;
+    for (int i = 0; i < entriesCount; i++) {
+        totalLookups += hist[i];
+        usedEntries += (hist[i] > 0);
+    }
+    printf("Lookups: %lld total, %d distinct entries used\n", totalLookups, usedEntries);
+    if (totalLookups == 0)
+        return 0;
+
+    //coverage of hot set
+    printf("\n%8s %8s %12s %12s %12s %12s\n", "lookups", "entries", "lines(orig)", "lines(pack)", "pages(orig)", "pages(pack)");
+    static const double fractions[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+    for (int q = 0; q < 5; q++) {
+        long long need = (long long)(fractions[q] * totalLookups + 0.5), sum = 0;
+        int cnt = 0;
+        while (cnt < usedEntries && sum < need)
+            sum += hist[order[cnt++]];
+        std::vector<long long> lines, pages;
+        for (int i = 0; i < cnt; i++) {
+            long long offset = (long long)order[i] * entrySize;
+            lines.push_back(offset / CacheLineSize);
+            pages.push_back(offset / PageSize);
+        }
+        std::sort(lines.begin(), lines.end());
+        std::sort(pages.begin(), pages.end());
+        long long linesOrig = std::unique(lines.begin(), lines.end()) - lines.begin();
+        long long pagesOrig = std::unique(pages.begin(), pages.end()) - pages.begin();
+        long long bytesPacked = (long long)cnt * entrySize;
+        printf("%7.1f%% %8d %12lld %12lld %12lld %12lld\n", fractions[q] * 100.0, cnt,
+            linesOrig, (bytesPacked + CacheLineSize - 1) / CacheLineSize,
+            pagesOrig, (bytesPacked + PageSize - 1) / PageSize
+        );
+    }
+
+    //hottest entries
+    printf("\nHottest entries:\n");
+    for (int i = 0; i < cfg.topCount && i < usedEntries; i++) {
+        int idx = order[i];
+        printf("  %5d:  %12lld  (%6.3f%%)  mask = ", idx, hist[idx], 100.0 * hist[idx] / totalLookups);
+        //decoder: bit k = byte k is continuation (bit 0 is dropped), encoder: bit pairs of code unit lengths
+        int bits = (decoder ? 15 : 8);
+        for (int b = 0; b < bits; b++)
+            printf("%d", (idx >> b) & 1);
+        printf("\n");
+    }
+
+    //profile-guided order: remap[original index] = new index
+    std::vector<uint16_t> remap(entriesCount);
+    for (int i = 0; i < entriesCount; i++)
+        remap[order[i]] = uint16_t(i);
+
+    if (cfg.remapPath) {
+        FILE *fo = fopen(cfg.remapPath, "wt");
+        if (!fo) {
+            printf("Cannot open file: %s\n", cfg.remapPath);
+            return 1;
+        }
+        fprintf(fo, "//profile-guided remap of LUT indices (generated by LutProfiler from %s)\n", cfg.inputPath);
+        fprintf(fo, "//reordered table is: packed[remap[i]] = original[i], hot entries come first\n");
+        fprintf(fo, "static const uint16_t LutRemap[%d] = {", entriesCount);
+        for (int i = 0; i < entriesCount; i++)
+            fprintf(fo, "%s%u", (i == 0 ? "\n    " : i % 16 ? ", " : ",\n    "), unsigned(remap[i]));
+        fprintf(fo, "\n};\n");
+        fclose(fo);
+        printf("\nWrote remap of %d entries to %s\n", entriesCount, cfg.remapPath);
+    }
+
+    if (cfg.replay) {
+        //build reordered copy of the original table
+        const char *original = (decoder ?
+            (cfg.checkMode == cmValidate ? (const char*)DecoderLutTable<true>::GetArray() : (const char*)DecoderLutTable<false>::GetArray()) :
+            (cfg.maxBytesFast == 3 ? (const char*)EncoderLutTable<true>::GetArray() : (const char*)EncoderLutTable<false>::GetArray())
+        );
+        size_t tableBytes = size_t(entriesCount) * entrySize;
+        char *packed = (char*)GetGlobalAllocator().Allocate(tableBytes, CACHE_LINE);
+        for (int i = 0; i < entriesCount; i++)
+            memcpy(packed + size_t(remap[i]) * entrySize, original + size_t(i) * entrySize, entrySize);
+
+        std::vector<int> sequence = GetLookupSequence(cfg, input.data(), inputSize);
+        static const int Runs = 20;
+        double cycOrig = MeasureLookups(sequence, original, entrySize, 0, Runs);
+        double cycPacked = MeasureLookups(sequence, packed, entrySize, remap.data(), Runs);
+        printf("\nReplay of %d lookups (best of %d runs):\n", int(sequence.size()), Runs);
+        printf("  original table         :  %0.3lf cyc/lookup\n", cycOrig);
+        printf("  reordered table + remap:  %0.3lf cyc/lookup\n", cycPacked);
+        GetGlobalAllocator().Deallocate(packed, tableBytes, CACHE_LINE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,319 @@
+// Search for inputs which are converted slowly (performance fuzzing).
+// Every input is a short pattern repeated many times, so that one mutation changes the whole input,
+// and periodic inputs can e.g. switch between fast path and slow path in every block.
+// The population of the slowest patterns is improved using mutations from TestsGenerator (same as in CorrectnessTests).
+// Only valid inputs are considered: invalid ones stop conversion at the first error, which is cheap.
+// So invalid parts are removed from every mutated pattern (with validation, they would be caught anyway).
+// The slowest inputs found are saved to files, which can be measured later as regression benchmarks
+// (see --suite=files in Benchmarks).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "buffer/ProcessorSelector.h"
+#include "message/MessageConverter.h"
+#include "core/ProcessTrivial.h"
+#include "tests/TestsGenerator.h"
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
+
+//linked from AllProcessors.cpp
+BaseBufferProcessor *GenerateProcessor(int srcFormat, int dstFormat, int maxBytes, int checkMode, int multiplier, int *errorCounter = 0, bool withStats = false);
+
+struct Config {
+    int srcFormat;              // -s=%s
+    int dstFormat;              // -d=%s
+    int maxBytesFast;           // -b=%d
+    int checkMode;              // -m=%d
+    int multiplier;             // -x=%d
+    int inputSize;              // --size=%d
+    int maxPatternSize;         // --pattern=%d
+    int iterations;             // -n=%d
+    int populationSize;         // --keep=%d
+    int saveCount;              // --save=%d
+    const char *outPrefix;      // --out=%s
+    unsigned seed;              // --seed=%u
+
+    Config() {
+        srcFormat = dfUtf8;
+        dstFormat = dfUtf16;
+        maxBytesFast = 3;
+        checkMode = cmValidate;
+        multiplier = 1;
+        inputSize = 1<<16;
+        maxPatternSize = 1024;
+        iterations = 3000;
+        populationSize = 16;
+        saveCount = 3;
+        outPrefix = "slow";
+        seed = 0;
+    }
+};
+static Config cfg;
+
+void PrintHelp() {
+    printf(
+        "Usage:\n"
+        "  PerfFuzzer [options]\n"
+        "Options:\n"
+        "  -s=%%s, -d=%%s   source / destination encoding: utf8, utf16, utf32 (default: -s=utf8 -d=utf16)\n"
+        "  -b=%%d          max bytes of fast path: 0, 1, 2 or 3 (default: 3)\n"
+        "  -m=%%d          checking mode: 0 (fast), 1 (full) or 2 (validate) (default: 2)\n"
+        "  -x=%%d          number of streams: 1 or 4 (default: 1)\n"
+        "  --size=%%d      size of every measured input in bytes (default: 65536)\n"
+        "  --pattern=%%d   max size of repeated pattern in bytes (default: 1024)\n"
+        "  -n=%%d          number of mutations to try (default: 3000)\n"
+        "  --keep=%%d      number of the slowest patterns kept in population (default: 16)\n"
+        "  --save=%%d      number of the slowest inputs to save (default: 3)\n"
+        "  --out=%%s       prefix of saved files: <%%s>_<src>-<dst>_<index>.bin (default: slow)\n"
+        "  --seed=%%u      seed of random generator (default: 0)\n"
+    );
+    exit(1);
+}
+
+int GetFormatOfEncoding(const char *encoding) {
+    if (strcmp(encoding, "utf8") == 0 || strcmp(encoding, "utf-8") == 0)
+        return dfUtf8;
+    if (strcmp(encoding, "utf16") == 0 || strcmp(encoding, "utf-16") == 0)
+        return dfUtf16;
+    if (strcmp(encoding, "utf32") == 0 || strcmp(encoding, "utf-32") == 0)
+        return dfUtf32;
+    return -1;
+}
+const char *GetFormatName(int format) {
+    return format == dfUtf8 ? "utf8" : format == dfUtf16 ? "utf16" : "utf32";
+}
+
+//=========================================== Patterns ============================================
+
+//removes invalid code units, and code points not supported by fast-only processor
+Data Sanitize(const TestsGenerator &gen, const Data &data) {
+    static const int UnitSize[3] = {1, 2, 4};
+    int maxCode = gen.MaxCode;
+    if (cfg.checkMode == cmFast)
+        maxCode = gen.MaxCodeOfSize(cfg.maxBytesFast);
+    Data res;
+    const uint8_t *ptr = data.data();
+    while (ptr < data.data() + data.size()) {
+        try {
+            int code = gen.ParseChar(data, ptr);
+            if (code <= maxCode)
+                gen.AddChar(res, code);
+        }
+        catch (std::runtime_error &) {
+            ptr += DMIN(UnitSize[cfg.srcFormat], int(data.data() + data.size() - ptr));
+        }
+    }
+    return res;
+}
+
+//repeats whole pattern while it fits into input size
+Data Tile(const Data &pattern) {
+    Data res = pattern;
+    while (res.size() + pattern.size() <= size_t(cfg.inputSize))
+        res.insert(res.end(), pattern.begin(), pattern.end());
+    return res;
+}
+
+void GetLengthsHistogram(const Data &data, long long hist[4]) {
+    memset(hist, 0, 4 * sizeof(hist[0]));
+    const char *begin = (const char *)data.data(), *end = begin + data.size();
+    if (cfg.srcFormat == dfUtf8)
+        CountCodePointLengths<1>(begin, end, hist);
+    else if (cfg.srcFormat == dfUtf16)
+        CountCodePointLengths<2>(begin, end, hist);
+    else
+        CountCodePointLengths<4>(begin, end, hist);
+}
+
+struct Candidate {
+    Data pattern;
+    double cyclesPerByte;
+};
+
+//returns the minimal number of cycles per byte over several conversions, or negative value on failure
+double Evaluate(BaseBufferProcessor &processor, const Data &input) {
+    static const int Runs = 5;
+    if (input.empty())
+        return -1.0;
+    std::vector<char> output(ConvertInMemorySize(processor, input.size()));
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < Runs; r++) {
+        uint64_t start = __rdtsc();
+        ConversionResult res = ConvertInMemory(processor, (const char *)input.data(), input.size(), output.data(), output.size());
+        uint64_t end = __rdtsc();
+        if (res.status != csSuccess)
+            return -1.0;
+        best = DMIN(best, end - start);
+    }
+    return double(best) / input.size();
+}
+
+//initial patterns: random code points of every combination of lengths,
+//and ASCII blocks with one long code point (fast path fails in every block)
+std::vector<Data> GenerateSeeds(TestsGenerator &gen, RND &rnd) {
+    std::vector<Data> res;
+    for (int mask = 1; mask < 16; mask++) {
+        int len = std::uniform_int_distribution<int>(4, 64)(rnd);
+        res.push_back(gen.CodesToData(gen.RandomCodes(len, mask)));
+    }
+    for (int bytes = 2; bytes <= 4; bytes++) {
+        std::vector<int> codes(15, 'a');
+        codes.push_back(gen.RandomCode(1 << (bytes - 1)));
+        res.push_back(gen.CodesToData(codes));
+    }
+    res.push_back(gen.BytesToData(gen.RandomBytes(64)));
+    for (size_t i = 0; i < res.size(); i++)
+        res[i] = Sanitize(gen, res[i]);
+    return res;
+}
+
+//============================================== Main =============================================
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int num;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+            PrintHelp();
+        else if (strncmp(arg, "-s=", 3) == 0)
+            cfg.srcFormat = GetFormatOfEncoding(arg + 3);
+        else if (strncmp(arg, "-d=", 3) == 0)
+            cfg.dstFormat = GetFormatOfEncoding(arg + 3);
+        else if (sscanf(arg, "-b=%d", &num) == 1)
+            cfg.maxBytesFast = num;
+        else if (sscanf(arg, "-m=%d", &num) == 1)
+            cfg.checkMode = num;
+        else if (sscanf(arg, "-x=%d", &num) == 1)
+            cfg.multiplier = num;
+        else if (sscanf(arg, "--size=%d", &num) == 1 && num > 0)
+            cfg.inputSize = num;
+        else if (sscanf(arg, "--pattern=%d", &num) == 1 && num > 0)
+            cfg.maxPatternSize = num;
+        else if (sscanf(arg, "-n=%d", &num) == 1 && num >= 0)
+            cfg.iterations = num;
+        else if (sscanf(arg, "--keep=%d", &num) == 1 && num > 0)
+            cfg.populationSize = num;
+        else if (sscanf(arg, "--save=%d", &num) == 1 && num >= 0)
+            cfg.saveCount = num;
+        else if (strncmp(arg, "--out=", 6) == 0)
+            cfg.outPrefix = arg + 6;
+        else if (sscanf(arg, "--seed=%u", &cfg.seed) == 1)
+            ;
+        else
+            PrintHelp();
+    }
+    if (cfg.srcFormat < 0 || cfg.dstFormat < 0)
+        PrintHelp();
+    if (cfg.srcFormat != dfUtf8 && cfg.dstFormat == dfUtf16)
+        cfg.dstFormat = dfUtf8;     //default destination for encoders
+
+    std::unique_ptr<BaseBufferProcessor> processor(GenerateProcessor(cfg.srcFormat, cfg.dstFormat, cfg.maxBytesFast, cfg.checkMode, cfg.multiplier));
+    std::unique_ptr<BaseBufferProcessor> statsProcessor(GenerateProcessor(cfg.srcFormat, cfg.dstFormat, cfg.maxBytesFast, cfg.checkMode, cfg.multiplier, 0, true));
+    if (!processor || !statsProcessor) {
+        printf("Unsupported settings: no such processor\n");
+        return 1;
+    }
+    if (cfg.checkMode == cmFast && cfg.maxBytesFast == 0) {
+        printf("Unsupported settings: fast-only processor must support some code points\n");
+        return 1;
+    }
+
+    RND rnd(cfg.seed);
+    TestsGenerator gen(DataFormat(cfg.srcFormat), rnd);
+    std::vector<Candidate> population;
+    auto addCandidate = [&](const Data &pattern) -> bool {
+        for (size_t i = 0; i < population.size(); i++)
+            if (population[i].pattern == pattern)
+                return false;
+        Candidate cand;
+        cand.pattern = pattern;
+        cand.cyclesPerByte = Evaluate(*processor, Tile(pattern));
+        if (cand.cyclesPerByte < 0.0)
+            return false;
+        if (int(population.size()) >= cfg.populationSize && cand.cyclesPerByte <= population.back().cyclesPerByte)
+            return false;
+        population.push_back(cand);
+        std::sort(population.begin(), population.end(), [](const Candidate &a, const Candidate &b) {
+            return a.cyclesPerByte > b.cyclesPerByte;
+        });
+        if (int(population.size()) > cfg.populationSize)
+            population.pop_back();
+        return true;
+    };
+
+    std::vector<Data> seeds = GenerateSeeds(gen, rnd);
+    for (size_t i = 0; i < seeds.size(); i++)
+        addCandidate(seeds[i]);
+    if (population.empty()) {
+        printf("No valid initial inputs\n");
+        return 1;
+    }
+    printf("Processor: %s-%s/b%d/m%d/x%d, input size: %d\n", GetFormatName(cfg.srcFormat), GetFormatName(cfg.dstFormat),
+        cfg.maxBytesFast, cfg.checkMode, cfg.multiplier, cfg.inputSize
+    );
+    printf("Slowest initial pattern: %0.3lf cyc/B\n", population[0].cyclesPerByte);
+
+    double bestScore = population[0].cyclesPerByte;
+    for (int iter = 0; iter < cfg.iterations; iter++) {
+        //tournament: slower patterns are chosen as parents more often
+        int count = int(population.size());
+        int idx = DMIN(std::uniform_int_distribution<int>(0, count - 1)(rnd), std::uniform_int_distribution<int>(0, count - 1)(rnd));
+        Data child = population[idx].pattern;
+        if (std::uniform_int_distribution<int>(0, 4)(rnd) == 0) {
+            const Data &other = population[std::uniform_int_distribution<int>(0, count - 1)(rnd)].pattern;
+            int t = std::uniform_int_distribution<int>(0, 2)(rnd);
+            if (t == 0) child = gen.MixConcatenate(child, other);
+            if (t == 1) child = gen.MixOneInsideOther(child, other);
+            if (t == 2) child = gen.MixInterleaveBytes(child, other);
+        }
+        gen.MutateSeveral(child);
+        child = Sanitize(gen, child);
+        if (int(child.size()) > cfg.maxPatternSize)
+            child = Substr(child, 0, gen.FindSplit(child, cfg.maxPatternSize));
+        if (!addCandidate(child))
+            continue;
+        if (population[0].cyclesPerByte > bestScore) {
+            bestScore = population[0].cyclesPerByte;
+            printf("Iteration %d: %0.3lf cyc/B (pattern of %d bytes)\n", iter, bestScore, int(population[0].pattern.size()));
+            fflush(stdout);
+        }
+    }
+
+    printf("\nSlowest patterns:\n");
+    for (size_t i = 0; i < population.size(); i++) {
+        Data input = Tile(population[i].pattern);
+        long long hist[4];
+        GetLengthsHistogram(population[i].pattern, hist);
+        //stats are collected with separate processor: it is slightly slower
+        statsProcessor->ResetStats();
+        std::vector<char> output(ConvertInMemorySize(*statsProcessor, input.size()));
+        ConvertInMemory(*statsProcessor, (const char *)input.data(), input.size(), output.data(), output.size());
+        const BaseBufferProcessor::Stats *stats = statsProcessor->GetStats();
+        printf("  %2d: %7.3lf cyc/B  pattern %4d bytes  lengths 1:%lld 2:%lld 3:%lld 4:%lld  slow path %0.1lf%%\n",
+            int(i), population[i].cyclesPerByte, int(population[i].pattern.size()), hist[0], hist[1], hist[2], hist[3],
+            100.0 * stats->slowBytes / DMAX(stats->fastBytes + stats->slowBytes, 1LL)
+        );
+    }
+
+    for (int i = 0; i < cfg.saveCount && i < int(population.size()); i++) {
+        char path[1024];
+        sprintf(path, "%.900s_%s-%s_%d.bin", cfg.outPrefix, GetFormatName(cfg.srcFormat), GetFormatName(cfg.dstFormat), i);
+        Data input = Tile(population[i].pattern);
+        FILE *f = fopen(path, "wb");
+        if (!f || fwrite(input.data(), 1, input.size(), f) != input.size()) {
+            printf("Cannot write file: %s\n", path);
+            return 1;
+        }
+        fclose(f);
+        printf("Saved: %s\n", path);
+    }
+    return 0;
+}